@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "base.h"
+#include "arena.h"
+
+SlabArena objarena;
+SlabArena trackarena;
+
+static __thread SlabCache caches[SLAB_ARENAS];
+static unsigned arenacount = 0;
+
+static const char *classnames[CClassTypes] = {
+  "Invalid", "Deleted", "Uninitialized", "Workspace", "MemoryWorkspace",
+  "BigEndianWorkspace", "LittleEndianWorkspace", "EvolSystem",
+  "EvolSystemBasic", "EvolSystemCombo", "Coderack", "CoderackNode",
+  "CoderackBranch", "CoderackRoot", "CoderackLeaf", "Codelet",
+  "ReadKeyboardCodelet", "QueueCodelet", "EvolaiCodelet",
+  "MoveSystemCodelet", "JumpSystemCodelet", "RepeatedCodelet",
+  "CheckWorkspace", "CheckCoderack", "WorkspaceRef", "WorkspaceElt",
+  "WorkspaceBond", "CheckMemory", "TextShowWorkspace", "TextShowElement",
+  "FlatCoderack", "ParallelCoderack", "CullSystemsCodelet"};
+
+/* Blocks come from this thread's cache, so only a refill locks; the
+   live bits are shared with other threads' blocks, so set atomically */
+void *SlabArena::Alloc(size_t size) {
+  unsigned sizecls = (size - 1) / SLAB_GRAIN;
+  SlabCache *cache;
+  SlabBlock *block;
+  Slab *slab;
+  unsigned index;
+
+  if (!ready)
+    Init();
+
+  if (!size || sizecls >= SLAB_CLASSES) {
+    __sync_fetch_and_add(&heapbytes, size);
+    __sync_fetch_and_add(&heapcount, 1);
+    return ::operator new(size);
+  }
+
+  cache = Cache();
+  if (!cache->count[sizecls])
+    Refill(cache, sizecls);
+  block = cache->blocks[sizecls];
+  cache->blocks[sizecls] = block->next;
+  cache->count[sizecls]--;
+
+  slab = (Slab *) ((unsigned long) block & ~(SLAB_SIZE - 1UL));
+  index = ((char *) block - slab->first) / ((sizecls + 1) * SLAB_GRAIN);
+  __sync_fetch_and_or(&slab->live[index >> 3], 1 << (index & 7));
+  __sync_fetch_and_add(&slab->used, 1);
+
+  return block;
+}
+
+/* A block freed by another thread than took it joins the freer's cache */
+void SlabArena::Free(void *ptr, size_t size) {
+  unsigned sizecls = (size - 1) / SLAB_GRAIN;
+  SlabBlock *block = (SlabBlock *) ptr;
+  SlabCache *cache;
+  Slab *slab;
+  unsigned index;
+  unsigned char was;
+
+  if (!ptr)
+    return;
+
+  if (!size || sizecls >= SLAB_CLASSES) {
+    __sync_fetch_and_sub(&heapbytes, size);
+    __sync_fetch_and_sub(&heapcount, 1);
+    ::operator delete(ptr);
+    return;
+  }
+
+  slab = (Slab *) ((unsigned long) ptr & ~(SLAB_SIZE - 1UL));
+  index = ((char *) ptr - slab->first) / ((sizecls + 1) * SLAB_GRAIN);
+  was = __sync_fetch_and_and(&slab->live[index >> 3],
+			     (unsigned char) ~(1 << (index & 7)));
+  aiassert(slab->sizecls == sizecls && (was & (1 << (index & 7))),
+	   "freeing a live slab block");
+  __sync_fetch_and_sub(&slab->used, 1);
+
+  cache = Cache();
+  block->next = cache->blocks[sizecls];
+  cache->blocks[sizecls] = block;
+  if (++cache->count[sizecls] >= 2 * SLAB_BATCH)
+    Flush(cache, sizecls, SLAB_BATCH);
+}
+
+void SlabArena::Walk(void (*visit)(void *block, size_t size, void *data),
+		     void *data) {
+  if (!ready)
+    return;
+
+  Lock();
+  for (unsigned sizecls = 0; sizecls < SLAB_CLASSES; sizecls++) {
+    size_t blocksize = (sizecls + 1) * SLAB_GRAIN;
+    for (Slab *slab = slabs[sizecls]; slab; slab = slab->next)
+      for (unsigned index = 0; index < slab->blocks; index++)
+	if (slab->live[index >> 3] & (1 << (index & 7)))
+	  visit(slab->first + index * blocksize, blocksize, data);
+  }
+  Unlock();
+}
+
+unsigned long SlabArena::SlabBytes() {
+  return slabcount * SLAB_SIZE;
+}
+
+unsigned long SlabArena::HeapBytes() {
+  return heapbytes;
+}
+
+unsigned long SlabArena::HeapCount() {
+  return heapcount;
+}
+
+/* Lazily, since AIObjects may be made before main() runs */
+void SlabArena::Init() {
+  pthread_mutexattr_t attr;
+
+  id = __sync_fetch_and_add(&arenacount, 1);
+  if (id >= SLAB_ARENAS) {
+    verbize(3, "debug", "More than %d slab arenas\n", SLAB_ARENAS);
+    exit(MEMORY_ERROR);
+  }
+  pthread_key_create(&cachekey, ReleaseCache);
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  for (unsigned sizecls = 0; sizecls < SLAB_CLASSES; sizecls++) {
+    slabs[sizecls] = NULL;
+    freelist[sizecls] = NULL;
+  }
+  slabcount = heapbytes = heapcount = 0;
+  ready = TRUE;
+}
+
+void SlabArena::Lock() {
+  if (aithreaded)
+    pthread_mutex_lock(&lock);
+}
+
+void SlabArena::Unlock() {
+  if (aithreaded)
+    pthread_mutex_unlock(&lock);
+}
+
+/* Carve a new slab into blocks, lowest address at the head of the list */
+Slab *SlabArena::NewSlab(unsigned sizecls) {
+  size_t blocksize = (sizecls + 1) * SLAB_GRAIN;
+  size_t header = (sizeof(Slab) + SLAB_GRAIN - 1) / SLAB_GRAIN * SLAB_GRAIN;
+  void *mem;
+  Slab *slab;
+
+  if (posix_memalign(&mem, SLAB_SIZE, SLAB_SIZE)) {
+    verbize(3, "debug", "Failed to allocate a slab for size %d\n", blocksize);
+    exit(MEMORY_ERROR);
+  }
+
+  slab = (Slab *) mem;
+  slab->sizecls = sizecls;
+  slab->first = (char *) mem + header;
+  slab->blocks = (SLAB_SIZE - header) / blocksize;
+  slab->used = 0;
+  memset(slab->live, 0, sizeof(slab->live));
+
+  for (unsigned index = slab->blocks; index > 0; index--) {
+    SlabBlock *block = (SlabBlock *) (slab->first + (index - 1) * blocksize);
+    block->next = freelist[sizecls];
+    freelist[sizecls] = block;
+  }
+
+  slab->next = slabs[sizecls];
+  slabs[sizecls] = slab;
+  slabcount++;
+
+  verbize(-4, "debug", "New slab %ld of %d byte blocks\n", slab, blocksize);
+
+  return slab;
+}
+
+/* This thread's cache, set to be given back when the thread exits */
+SlabCache *SlabArena::Cache() {
+  SlabCache *cache = &caches[id];
+
+  if (!cache->arena) {
+    cache->arena = this;
+    pthread_setspecific(cachekey, cache);
+  }
+  return cache;
+}
+
+void SlabArena::Refill(SlabCache *cache, unsigned sizecls) {
+  Lock();
+  for (unsigned n = 0; n < SLAB_BATCH; n++) {
+    SlabBlock *block;
+
+    if (!freelist[sizecls])
+      NewSlab(sizecls);
+    block = freelist[sizecls];
+    freelist[sizecls] = block->next;
+    block->next = cache->blocks[sizecls];
+    cache->blocks[sizecls] = block;
+  }
+  cache->count[sizecls] += SLAB_BATCH;
+  Unlock();
+}
+
+/* Gives all but keep of the cached blocks back to the free list */
+void SlabArena::Flush(SlabCache *cache, unsigned sizecls, unsigned keep) {
+  Lock();
+  while (cache->count[sizecls] > keep) {
+    SlabBlock *block = cache->blocks[sizecls];
+
+    cache->blocks[sizecls] = block->next;
+    block->next = freelist[sizecls];
+    freelist[sizecls] = block;
+    cache->count[sizecls]--;
+  }
+  Unlock();
+}
+
+void SlabArena::ReleaseCache(void *data) {
+  SlabCache *cache = (SlabCache *) data;
+
+  for (unsigned sizecls = 0; sizecls < SLAB_CLASSES; sizecls++)
+    cache->arena->Flush(cache, sizecls, 0);
+  cache->arena = NULL;
+}
+
+/**********************/
+
+struct ClassUsage {
+  unsigned long count[CClassTypes];
+  unsigned long bytes[CClassTypes];
+};
+
+static void TallyObject(void *block, size_t size, void *data) {
+  struct ClassUsage *usage = (struct ClassUsage *) data;
+  classtype type = ((AIObject *) block)->type;
+
+  if (type < 0 || type >= CClassTypes)
+    type = CInvalidClass;
+  usage->count[type]++;
+  usage->bytes[type] += size;
+}
+
+/* Live objects and bytes per classtype, for sizing a deployment */
+void ArenaReport() {
+  struct ClassUsage usage;
+
+  memset(&usage, 0, sizeof(usage));
+  objarena.Walk(TallyObject, &usage);
+
+  verbize(1, "memory", "Objects: %ld bytes in slabs, %ld bytes in %ld large; "
+	  "tracking: %ld bytes in slabs\n", objarena.SlabBytes(),
+	  objarena.HeapBytes(), objarena.HeapCount(), trackarena.SlabBytes());
+  for (unsigned type = 0; type < CClassTypes; type++)
+    if (usage.count[type])
+      verbize(1, "memory", "  %-22s %8ld objects %10ld bytes\n",
+	      classnames[type], usage.count[type], usage.bytes[type]);
+}
@@ -0,0 +1,84 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SLAB_SIZE 65536   /* bytes per slab, which is also its alignment */
+#define SLAB_GRAIN 16     /* block sizes are rounded up to this */
+#define SLAB_CLASSES 32   /* objects over SLAB_GRAIN * SLAB_CLASSES aren't */
+#define SLAB_BLOCKS (SLAB_SIZE / SLAB_GRAIN)  /* most blocks in a slab */
+#define SLAB_BATCH 32     /* blocks a thread's cache takes or gives back */
+#define SLAB_ARENAS 4     /* most arenas, each with a cache in every thread */
+
+/* One SLAB_SIZE-aligned run of equal-sized blocks; the header sits at
+   the front, so any block finds its slab by masking its address */
+struct Slab {
+  Slab *next;  /* slabs of the same size class */
+  unsigned sizecls;
+  unsigned blocks;  /* how many fit after the header */
+  unsigned used;
+  char *first;
+  unsigned char live[SLAB_BLOCKS / 8];
+};
+
+struct SlabBlock {
+  SlabBlock *next;
+};
+
+class SlabArena;
+
+/* A thread's free blocks for one arena, by size class */
+struct SlabCache {
+  SlabArena *arena;  /* NULL until the thread first uses it */
+  SlabBlock *blocks[SLAB_CLASSES];
+  unsigned count[SLAB_CLASSES];
+};
+
+/* Size-segregated slab allocator: O(1) alloc and free, objects of a
+   class packed densely together.  Larger objects fall through to the
+   heap but are still counted.  Each thread allocates from and frees to
+   its own cache of blocks, which it trades with the shared free lists
+   SLAB_BATCH at a time under the lock. */
+class SlabArena {
+public:
+  void *Alloc(size_t size);
+  void Free(void *ptr, size_t size);
+
+  /* Calls back for every live slab block, with its usable size */
+  void Walk(void (*visit)(void *block, size_t size, void *data), void *data);
+
+  unsigned long SlabBytes();
+  unsigned long HeapBytes();
+  unsigned long HeapCount();
+
+private:
+  void Init();
+  void Lock();
+  void Unlock();
+  Slab *NewSlab(unsigned sizecls);
+
+  SlabCache *Cache();
+  void Refill(SlabCache *cache, unsigned sizecls);
+  void Flush(SlabCache *cache, unsigned sizecls, unsigned keep);
+  static void ReleaseCache(void *cache);  // at thread exit
+
+  int ready;
+  unsigned id;  /* which of each thread's caches is ours */
+  pthread_mutex_t lock;
+  pthread_key_t cachekey;
+
+  Slab *slabs[SLAB_CLASSES];
+  SlabBlock *freelist[SLAB_CLASSES];
+  unsigned long slabcount;
+  unsigned long heapbytes;  /* outside the slabs */
+  unsigned long heapcount;
+};
+
+/* AIObjects, and the memtrack links made for each */
+extern SlabArena objarena;
+extern SlabArena trackarena;
+
+void ArenaReport();
+
+#endif
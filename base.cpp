@@ -5,10 +5,13 @@
 #include <math.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <signal.h>
 #include <exception>
 
-/* Usage: artintel [-h] [-v] [-q] [-i <file>] [-o <file>]
-   [-V topic] [-Q topic] [-d <datafile>]*/
+/* Usage: artintel [-h] [-v] [-q] [-f] [-m] [-j] [-c] [-b <batch>]
+   [-w <workers>] [-M <megabytes>] [-L <levels>] [-p <systems>] [-I <image>]
+   [-i <file>] [-o <file>] [-V topic] [-Q topic] [-d <datafile>]*/
 
 extern int errno;
 
@@ -18,30 +21,60 @@ extern int errno;
 #include "checker.h"
 #include "textshow.h"
 #include "readall.h"
+#include "system.h"
+#include "jit.h"
+#include "memo.h"
+#include "population.h"
+#include "evolet.h"
 
 #define VERBIZE_FILE "/tmp/output.txt"
 #define VERBIZE_BUFF 4194304
 #define VERBIZE_FILE_X "/tmp/output2.txt"
 #define OUTPUT_COUNT 100
+#define BATCH_COUNT 1     /* codelets drawn per pass of the main loop */
 
 float effectiveness = 0;
 unsigned long predtotal = 0;
 int whichfile = 0;        // only used if VERBIZE_BUFF and VERBIZE_FILE_X
+int aithreaded = FALSE;
+static pthread_mutex_t verblock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Set by signals, acted on between passes of the main loop */
+static volatile sig_atomic_t syncwanted = FALSE;
+static volatile sig_atomic_t stopwanted = FALSE;
+
+static void SignalImage(int sig) {
+  if (sig == SIGUSR1)
+    syncwanted = TRUE;
+  else
+    stopwanted = TRUE;
+}
+
+/* Built with NO_MAIN, this file lends its helpers to the programs in at */
+#ifndef NO_MAIN
 int main(int argc, char *argv[]) {
   int c;
   extern char *optarg;
   extern int optind;
   char initd = FALSE;
+  char memreport = FALSE;
 
   unsigned long ocount = OUTPUT_COUNT;
+  unsigned batch = BATCH_COUNT;
+  unsigned long ceiling = WS_MEMORY_CEILING;
+  unsigned long lastcopied = 0;
+  struct timeval lasttime, now;
   MemoryWorkspace *baseWorkspace;
+  Workspace *levels[TOWER_MAX];  /* the tower, from the top level down */
+  unsigned levelcount = 1;
+  ImageWorkspace *imageWorkspace = NULL;
+  const char *image = NULL;
 
   verbize(1, "", "Initializing...\n");
 
   TrackLink::MemInitialize();
 
-  while ((c = getopt(argc, argv, "hvqV:Q:d:")) != EOF)
+  while ((c = getopt(argc, argv, "hvqfmjcb:w:M:L:p:I:V:Q:d:")) != EOF)
     switch (c) {
     case 'v':
       verbize(-2, "", "Verbosity increased to %d.\n",
@@ -59,6 +92,58 @@ int main(int argc, char *argv[]) {
       verbize(-2, "", "Verbosity decreased to %d.\n",
 	      change_verbosity(optarg, -1));
       break;
+    case 'f':
+      Coderack::engine = FLAT_ENGINE;
+      verbize(-2, "", "Using flat coderack engine.\n");
+      break;
+    case 'm':
+      memreport = TRUE;
+      verbize(-2, "", "Reporting memory use with the status line.\n");
+      break;
+    case 'j':
+      EvolSystemBasic::jit = TRUE;
+      verbize(-2, "", "Compiling hot genomes to native code.\n");
+      break;
+    case 'c':
+      PredictionCache::enabled = FALSE;
+      verbize(-2, "", "Not caching predictions.\n");
+      break;
+    case 'b':
+      batch = atoi(optarg);
+      if (batch < 1)
+	batch = 1;
+      verbize(-2, "", "Executing %d codelets per pass.\n", batch);
+      break;
+    case 'w':
+      Coderack::workers = atoi(optarg);
+      if (Coderack::workers < 1)
+	Coderack::workers = 1;
+      verbize(-2, "", "Running %d coderack workers.\n", Coderack::workers);
+      break;
+    case 'M':
+      ceiling = atol(optarg);
+      if (ceiling < 1)
+	ceiling = 1;
+      verbize(-2, "", "Workspace memory ceiling of %ld MB.\n", ceiling);
+      break;
+    case 'L':
+      levelcount = atoi(optarg);
+      if (levelcount < 1)
+	levelcount = 1;
+      if (levelcount > TOWER_MAX)
+	levelcount = TOWER_MAX;
+      verbize(-2, "", "Stacking %d workspace levels.\n", levelcount);
+      break;
+    case 'p':
+      SystemPopulation::budget = atol(optarg);
+      verbize(-2, "", "Keeping at most %ld systems.\n",
+	      SystemPopulation::budget);
+      break;
+    case 'I':
+      image = optarg;
+      verbize(-2, "", "Keeping the workspace image %s.\n", image);
+      verbize(-2, "", "Send SIGUSR1 to write it; it's also written on SIGINT or SIGTERM.\n");
+      break;
     case 'd': {
       FILE *fp = fopen(optarg, "rb");
       struct BasePointers adnl;
@@ -70,18 +155,51 @@ int main(int argc, char *argv[]) {
     }
     case '?':
       verbize(3, "",
-	      "Usage: %s [-q] [-v] [-h] [-i <file>] [-o <file>]\n",
+	      "Usage: %s [-q] [-v] [-h] [-f] [-m] [-j] [-c] [-b <batch>] [-w <workers>] [-M <megabytes>] [-L <levels>] [-p <systems>] [-I <image>] [-i <file>] [-o <file>]\n",
 	      argv[0]);
       exit(BADARG_ERROR);
     case 'h':
       verbize(3, "",
-	      "Usage: %s [-q] [-v] [-h] [-i <file>] [-o <file>]\n",
+	      "Usage: %s [-q] [-v] [-h] [-f] [-m] [-j] [-c] [-b <batch>] [-w <workers>] [-M <megabytes>] [-L <levels>] [-p <systems>] [-I <image>] [-i <file>] [-o <file>]\n",
 	      argv[0]);
       break;
     }
 
   if (!initd) {
-    baseWorkspace = new MemoryWorkspace(65536, nullwsref, nullwsref, 1, 65536);
+    /* Levels grow geometrically from TOWER_TOP_BYTES at the top to the
+       ceiling at the bottom, and each runs TOWER_SHARE times the
+       codelets of the one below it */
+    unsigned long topbytes = levelcount > 1 ? TOWER_TOP_BYTES : ceiling << 20;
+    double growth = levelcount > 1 ?
+      pow((double) (ceiling << 20) / TOWER_TOP_BYTES, 1. / (levelcount - 1)) :
+      1.;
+    unsigned budget = batch;
+    MemoryWorkspace *lower = NULL;
+
+    for (unsigned l = levelcount - 1; l > 0; l--) {
+      MemoryWorkspace *level =
+	new MemoryWorkspace(MemoryWorkspace::
+			    CeilingIndex((unsigned long)
+					 (TOWER_TOP_BYTES * pow(growth, l))),
+			    nullwsref, lower, levelcount - l, 65536);
+      level->SetBudget(budget);
+      budget *= TOWER_SHARE;
+      if (lower)
+	lower->SetHigherWorkspace(level);
+      lower = level;
+    }
+
+    if (image)
+      baseWorkspace = imageWorkspace =
+	new BigEndianWorkspace(image, MemoryWorkspace::CeilingIndex(topbytes),
+			       nullwsref, lower, levelcount, 65536);
+    else
+      baseWorkspace =
+	new MemoryWorkspace(MemoryWorkspace::CeilingIndex(topbytes),
+			    nullwsref, lower, levelcount, 65536);
+    baseWorkspace->SetBudget(budget);
+    if (lower)
+      lower->SetHigherWorkspace(baseWorkspace);
     TrackLink::MemStore(TrackLink::root, &baseWorkspace, FALSE);
     baseWorkspace->GetCoderack().
       AddCodelet(new ReadKeyboardCodelet(NULL, baseWorkspace, UrgeRange / 4));
@@ -93,27 +211,91 @@ int main(int argc, char *argv[]) {
       AddCodelet(new CheckCoderack(baseWorkspace->GetCoderack()));
     baseWorkspace->GetCoderack().
       AddCodelet(new CheckMemory(baseWorkspace->GetCoderack()));
+    if (SystemPopulation::budget)
+      baseWorkspace->GetCoderack().
+	AddCodelet(new CullSystemsCodelet(*baseWorkspace));
     baseWorkspace->GetCoderack().
       AddCodelet(new TypeDocumentCodelet("input.txt",
 					 &baseWorkspace->GetCoderack()));
     initd = TRUE;
   }
 
+  levelcount = 0;
+  for (Workspace *ws = baseWorkspace; ws && levelcount < TOWER_MAX;
+       ws = ws->GetLowerWorkspace())
+    levels[levelcount++] = ws;
+
+  if (imageWorkspace) {
+    signal(SIGUSR1, SignalImage);
+    signal(SIGINT, SignalImage);
+    signal(SIGTERM, SignalImage);
+  }
+
   verbize(1, "", "Processing...\n");
+  gettimeofday(&lasttime, NULL);
 
   while (1) {
     try {
-      baseWorkspace->GetCoderack().ExecuteCodelet();
+      for (unsigned l = 0; l < levelcount; l++)
+	if (levels[l]->GetBudget() > 1)
+	  levels[l]->GetCoderack().ExecuteCodelets(levels[l]->GetBudget());
+	else
+	  levels[l]->GetCoderack().ExecuteCodelet();
     } catch (std::exception &e) {
       verbize(2, "error", "Exception: %s", e.what());
     }
+    if (syncwanted || stopwanted) {
+      baseWorkspace->GetCoderack().Quiesce();
+      verbize(1, "status", "Writing the workspace image %s\n",
+	      imageWorkspace->GetPath());
+      imageWorkspace->Sync();
+      if (stopwanted)
+	exit(0);
+      syncwanted = FALSE;
+      baseWorkspace->GetCoderack().Resume();
+    }
     if (!(--ocount)) {
+      baseWorkspace->GetCoderack().Quiesce();
       // Status Line
       verbize(1, "status", "Workspace: %ld; Coderack: %ld (%f) => (%f for %ld) :: %f\n",
 	      baseWorkspace->GetCurrentIndex(),
 	      baseWorkspace->GetCoderack().getSize(),
 	      baseWorkspace->GetCoderack().getTotalUrgency(),
 	      effectiveness / (double) predtotal, predtotal, EvolSystem::GetAverageAge());
+      gettimeofday(&now, NULL);
+      verbize(1, "status", "Element copies: %ld bytes/s; evictions: %ld\n",
+	      (unsigned long) ((WorkspaceElt::copiedbytes - lastcopied) /
+			       (now.tv_sec - lasttime.tv_sec +
+				(now.tv_usec - lasttime.tv_usec) / 1e6 + 1e-6)),
+	      baseWorkspace->GetEvictions());
+      lastcopied = WorkspaceElt::copiedbytes;
+      lasttime = now;
+      if (EvolSystemBasic::jit)
+	verbize(1, "status", "Genomes compiled: %ld\n", GenomeCode::compiled);
+      if (PredictionCache::enabled)
+	verbize(1, "status", "Prediction cache: %ld hits, %ld misses (%f)\n",
+		PredictionCache::GetHits(), PredictionCache::GetMisses(),
+		PredictionCache::GetHits() /
+		(double) (PredictionCache::GetHits() +
+			  PredictionCache::GetMisses() + 1));
+      if (SystemPopulation::budget)
+	verbize(1, "status", "Systems: %ld live, %ld culled\n",
+		SystemPopulation::GetCount(),
+		SystemPopulation::GetCulledCount());
+      if (levelcount > 1) {
+	unsigned long accesses = 0;
+
+	for (unsigned l = 0; l < levelcount; l++)
+	  accesses += levels[l]->GetAccesses();
+	for (unsigned l = 0; l < levelcount; l++)
+	  verbize(1, "status", "Level %d: %ld of %ld; %ld up, %ld down; hits %f; codelets %ld\n",
+		  l, levels[l]->GetCurrentIndex(), levels[l]->GetMaxIndex(),
+		  levels[l]->GetPromotions(), levels[l]->GetDemotions(),
+		  levels[l]->GetAccesses() / (double) (accesses + 1),
+		  levels[l]->GetCoderack().getSize());
+      }
+      if (memreport)
+	ArenaReport();
       ocount = OUTPUT_COUNT;
       // Output Test
       struct BasePointers adnl;
@@ -121,6 +303,8 @@ int main(int argc, char *argv[]) {
 
       FILE *fp = fopen("allobjs.dat", "w");
       TrackLink::WriteAllObjects(fp, &adnl, sizeof(struct BasePointers));
+      fclose(fp);
+      baseWorkspace->GetCoderack().Resume();
     }
   }
 
@@ -134,6 +318,7 @@ int main(int argc, char *argv[]) {
     
   TrackLink::MemDestroy();
 }
+#endif
 
 /* Well behaved fopen */
 FILE *aifopen(const char *filename, const char *mode, const char *purpose,
@@ -186,6 +371,8 @@ void verbize(int verbity, char *topic, char *format, ...) {
       verbtot += curr->level;
 
   if (verbity + verbtot >= 0) {
+    if (aithreaded)
+      pthread_mutex_lock(&verblock);
     va_start(ap, format);
     if (VERBIZE_FILE) {
       if (!whichfile)
@@ -216,6 +403,8 @@ void verbize(int verbity, char *topic, char *format, ...) {
     } else
       vprintf(format, ap);
     va_end(ap);
+    if (aithreaded)
+      pthread_mutex_unlock(&verblock);
   }
 }
 
@@ -265,6 +454,14 @@ void aiassert(int abool, char *purpose) {
   }
 }
 
+/* Wall-clock time, for the timing programs */
+double Seconds() {
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
 int ProbToBool(float prob) {
   if (prob > .5)
     return (frand() > exp(10. * (.5 - prob)));
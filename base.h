@@ -20,8 +20,11 @@ typedef enum {CInvalidClass, CDeletedClass, CUninitializedClass,
 	      CCoderackRoot, CCoderackLeaf, CCodelet, CReadKeyboardCodelet,
 	      CQueueCodelet, CEvolaiCodelet, CMoveSystemCodelet,
 	      CJumpSystemCodelet, CRepeatedCodelet, CCheckWorkspace,
-	      CCheckCoderack, CWorkspaceRef, CWorkspaceElt, CWorkspaceBond,
-	      CCheckMemory, CTextShowWorkspace, CTextShowElement}
+	      CCheckCoderack, CWorkspaceRef, CWorkspaceElt,
+	      CWorkspaceBond,  /* bonds are now by value; keeps later values */
+	      CCheckMemory, CTextShowWorkspace, CTextShowElement,
+	      CFlatCoderack, CParallelCoderack, CCullSystemsCodelet,
+	      CClassTypes}  /* count of the above; add new ones before it */
 classtype;
 
 /* AIObject class from which everything inherits */
@@ -42,6 +45,15 @@ public:
     TrackLink::MemForget(trackid);
   }
 
+  /* All objects come from the slab arena, sized by their real class */
+  static void *operator new(size_t size) {
+    return objarena.Alloc(size);
+  }
+
+  static void operator delete(void *ptr, size_t size) {
+    objarena.Free(ptr, size);
+  }
+
   virtual int WriteObject(FILE *fp) {
     return fwrite(&type, sizeof(classtype), 1, fp);
   }
@@ -85,6 +97,7 @@ void *airealloc(void *ptr, size_t size, char *purpose, int fatal, int vi);
 void aiassert(int abool, char *purpose);
 void aifree(void *ptr);
 int ProbToBool(float prob);
+double Seconds();
 
 struct verblist {
   char topic[32];
@@ -95,6 +108,7 @@ struct verblist {
 static struct verblist verbosity = {"", 0, NULL};
 
 void verbize(int verbity, char *topic, char *format, ...);
+extern int aithreaded;  // set once coderack workers are running
 int change_verbosity(char *topic, int change);
 
 #define TRUE 1
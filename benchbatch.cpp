@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "base.h"
+#include "system.h"
+#include "memo.h"
+
+/* Times ExecuteBatch over random genome populations, running each system
+   alone and with those that never write stepped in lanes, and checks the
+   two give the same predictions.  Each way runs its own copy of the
+   population, bred from the same genomes.  Random genomes nearly all
+   write somewhere, so a second population has its writes taken out.
+   The prediction cache and native code are off, as lanes use neither.
+
+   Usage: benchbatch [<systems>] [<rounds>] */
+
+#define BENCH_SYSTEMS 1024
+#define BENCH_ROUNDS 200
+#define BENCH_MAXLEN 200
+
+class BenchSystem : public EvolSystemBasic {
+public:
+  BenchSystem(unsigned char *newdna, unsigned newlen) :
+    EvolSystemBasic(newdna, newlen) {}
+};
+
+int main(int argc, char *argv[]) {
+  unsigned systems = argc > 1 ? atoi(argv[1]) : BENCH_SYSTEMS;
+  unsigned long rounds = argc > 2 ? atol(argv[2]) : BENCH_ROUNDS;
+  EvolSystem **alone, **lanes;
+  char *predalone, *predlanes;
+  unsigned char dna[BENCH_MAXLEN];
+  unsigned long failures = 0;
+
+  TrackLink::MemInitialize();
+  PredictionCache::enabled = FALSE;
+  EvolSystemBasic::jit = FALSE;
+  alone = (EvolSystem **) aialloc(systems * sizeof(EvolSystem *),
+				  "benchmark systems", 1, -3);
+  lanes = (EvolSystem **) aialloc(systems * sizeof(EvolSystem *),
+				  "benchmark systems", 1, -3);
+  predalone = (char *) aialloc(systems, "benchmark predictions", 1, -3);
+  predlanes = (char *) aialloc(systems, "benchmark predictions", 1, -3);
+
+  printf("%10s %10s %14s %14s %10s\n", "genomes", "batchable", "alone/s",
+	 "lanes/s", "differ");
+  for (int nowrites = 0; nowrites < 2; nowrites++) {
+    unsigned batchable = 0;
+    unsigned long differ = 0;
+    double start, timealone = 0, timelanes = 0;
+
+    srand(1);
+    for (unsigned s = 0; s < systems; s++) {
+      unsigned len = 1 + rand() % BENCH_MAXLEN;
+
+      for (unsigned at = 0; at < len; at++) {
+	dna[at] = rand() % 256;
+	if (nowrites) {  /* op_write is opcode 2 */
+	  if ((dna[at] & 15) == 2)
+	    dna[at] ^= 1;
+	  if ((dna[at] >> 4) == 2)
+	    dna[at] ^= 16;
+	}
+      }
+      alone[s] = new BenchSystem(dna, len);
+      lanes[s] = new BenchSystem(dna, len);
+      alone[s]->AddReference();
+      lanes[s]->AddReference();
+      batchable += ((EvolSystemBasic *) lanes[s])->Batchable();
+    }
+
+    for (unsigned long r = 0; r < rounds; r++) {
+      char input = rand() % 256;
+
+      EvolSystemBasic::lockstep = FALSE;
+      start = Seconds();
+      EvolSystem::ExecuteBatch(alone, systems, input, predalone);
+      timealone += Seconds() - start;
+
+      EvolSystemBasic::lockstep = TRUE;
+      start = Seconds();
+      EvolSystem::ExecuteBatch(lanes, systems, input, predlanes);
+      timelanes += Seconds() - start;
+
+      for (unsigned s = 0; s < systems; s++)
+	differ += predalone[s] != predlanes[s];
+    }
+
+    printf("%10s %9.1f%% %14.0f %14.0f %10ld\n",
+	   nowrites ? "no writes" : "random", 100. * batchable / systems,
+	   systems * rounds / timealone, systems * rounds / timelanes, differ);
+    failures += differ;
+
+    for (unsigned s = 0; s < systems; s++) {
+      alone[s]->RemoveReference();
+      lanes[s]->RemoveReference();
+    }
+  }
+
+  aifree(alone);
+  aifree(lanes);
+  aifree(predalone);
+  aifree(predlanes);
+  TrackLink::MemDestroy();
+  return failures ? 1 : 0;
+}
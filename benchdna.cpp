@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "base.h"
+#include "system.h"
+
+/* Times the genome buffers of systems: short genomes held inline, longer
+   ones in pooled buffers.  For each length, makes and frees systems,
+   then breeds and mutates offspring of one parent and frees them, and
+   last makes and frees bare aialloc buffers of that length, which is
+   what each genome cost before either.
+
+   Usage: benchdna [<rounds>] */
+
+#define BENCH_ROUNDS 200000
+#define BENCH_MAXLEN 1024
+
+class BenchSystem : public EvolSystemBasic {
+public:
+  BenchSystem(unsigned char *newdna, unsigned newlen) :
+    EvolSystemBasic(newdna, newlen) {}
+};
+
+int main(int argc, char *argv[]) {
+  unsigned long rounds = argc > 1 ? atol(argv[1]) : BENCH_ROUNDS;
+  unsigned lengths[] = {16, DNA_INLINE, 48, 200, BENCH_MAXLEN};
+  unsigned char dna[BENCH_MAXLEN];
+
+  TrackLink::MemInitialize();
+  srand(1);
+  for (unsigned at = 0; at < BENCH_MAXLEN; at++)
+    dna[at] = rand() % 256;
+
+  printf("%8s %8s %14s %14s %14s\n", "length", "held", "systems/s",
+	 "offspring/s", "aialloc/s");
+  for (unsigned l = 0; l < sizeof(lengths) / sizeof(unsigned); l++) {
+    unsigned len = lengths[l];
+    double start, made, bred, bare;
+
+    start = Seconds();
+    for (unsigned long i = 0; i < rounds; i++) {
+      EvolSystemPtr sys = new BenchSystem(dna, len);
+    }
+    made = Seconds() - start;
+
+    EvolSystemPtr parent = new BenchSystem(dna, len);
+    start = Seconds();
+    for (unsigned long i = 0; i < rounds; i++) {
+      EvolSystemPtr child = parent->reproduce();
+
+      child->mutate();
+    }
+    bred = Seconds() - start;
+
+    start = Seconds();
+    for (unsigned long i = 0; i < rounds; i++) {
+      unsigned char *block = (unsigned char *)
+	aialloc(len, "benchmark genome", 1, -3);
+
+      memcpy(block, dna, len);
+      aifree(block);
+    }
+    bare = Seconds() - start;
+
+    printf("%8d %8s %14.0f %14.0f %14.0f\n", len,
+	   len <= DNA_INLINE ? "inline" : "pooled", rounds / made,
+	   rounds / bred, rounds / bare);
+  }
+
+  TrackLink::MemDestroy();
+  return 0;
+}
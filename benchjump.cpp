@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "base.h"
+#include "workspace.h"
+
+/* Times finding a salient element of a given value, as JumpSystemCodelet
+   does: by the random-stride scan it used to make, and through the
+   value index (SalientWithValue).  Values are uniform over 0-255.
+
+   Usage: benchjump [<largest workspace>] */
+
+#define BENCH_SMALLEST 1000
+#define BENCH_LARGEST 1000000
+#define BENCH_LOOKUPS 100000
+
+/* The scan JumpSystemCodelet made before the index */
+int ScanForValue(Workspace *ws, Value val, CNIndex exclude, CNIndex *found) {
+  int spacing = ws->GetCurrentIndex() / 256 + 1;
+
+  for (unsigned long i = irand(spacing); i < ws->GetCurrentIndex();
+       i += irand(spacing) + 1)
+    if (ws->SalientElement(i).BorrowElement().GetValue() == val) {
+      if (i == exclude)
+	continue;
+      *found = i;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long largest = argc > 1 ? atol(argv[1]) : BENCH_LARGEST;
+
+  TrackLink::MemInitialize();
+
+  printf("%10s %14s %14s %8s %8s\n", "elements", "scans/s", "indexed/s",
+	 "scan hit", "idx hit");
+  for (unsigned long n = BENCH_SMALLEST; n <= largest; n *= 10) {
+    MemoryWorkspace *ws = new MemoryWorkspace(n, NULL, NULL, 1, 65536);
+    unsigned long scanhits = 0, indexhits = 0;
+    double start, scanned, indexed;
+    CNIndex found;
+
+    srand(1);
+    for (unsigned long i = 0; i < n; i++) {
+      Value val = rand() % 256;
+      WorkspaceElt elt(val);
+
+      ws->AddElement(elt);
+    }
+    ws->SalientWithValue(0, 0, &found);  /* builds the index */
+
+    start = Seconds();
+    for (unsigned long i = 0; i < BENCH_LOOKUPS; i++) {
+      Value val = rand() % 256;
+      CNIndex exclude = rand() % n;
+
+      scanhits += ScanForValue(ws, val, exclude, &found);
+    }
+    scanned = Seconds() - start;
+
+    start = Seconds();
+    for (unsigned long i = 0; i < BENCH_LOOKUPS; i++) {
+      Value val = rand() % 256;
+      CNIndex exclude = rand() % n;
+
+      indexhits += ws->SalientWithValue(val, exclude, &found);
+    }
+    indexed = Seconds() - start;
+
+    printf("%10ld %14.0f %14.0f %8ld %8ld\n", n, BENCH_LOOKUPS / scanned,
+	   BENCH_LOOKUPS / indexed, scanhits, indexhits);
+    delete ws;
+  }
+
+  TrackLink::MemDestroy();
+  return 0;
+}
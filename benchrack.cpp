@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "base.h"
+#include "coderack.h"
+#include "codelets.h"
+
+/* Times the tree and flat coderack engines, each made by Coderack::Create:
+   filling a rack, then drawing and running codelets while topping it
+   back up, as the main loop does.
+
+   Usage: benchrack [<largest rack>] */
+
+#define BENCH_SMALLEST 1000
+#define BENCH_LARGEST 1000000
+#define BENCH_DRAWS 4  /* draws per codelet in the rack */
+
+class NullCodelet : public Codelet {
+public:
+  NullCodelet(urgetype urge) : Codelet(urge) {}
+
+  virtual void Execute() {}
+  virtual const char *Class() const { return "NullCodelet"; }
+  virtual int AssertValid() { return TRUE; }
+};
+
+int main(int argc, char *argv[]) {
+  unsigned long largest = argc > 1 ? atol(argv[1]) : BENCH_LARGEST;
+  const char *names[2] = {"tree", "flat"};
+  int engines[2] = {TREE_ENGINE, FLAT_ENGINE};
+
+  TrackLink::MemInitialize();
+
+  printf("%10s %6s %14s %14s\n", "codelets", "engine", "adds/s", "draws/s");
+  for (unsigned long n = BENCH_SMALLEST; n <= largest; n *= 10)
+    for (int e = 0; e < 2; e++) {
+      Coderack *rack;
+      double start, added, drawn;
+
+      srand(1);
+      Coderack::engine = engines[e];
+      rack = Coderack::Create(n, 1);
+
+      start = Seconds();
+      for (unsigned long i = 0; i < n; i++)
+	rack->AddCodelet(new NullCodelet(frand() * UrgeRange + 1e-3));
+      added = Seconds() - start;
+
+      start = Seconds();
+      for (unsigned long i = 0; i < BENCH_DRAWS * n; i++) {
+	rack->ExecuteCodelet();
+	rack->AddCodelet(new NullCodelet(frand() * UrgeRange + 1e-3));
+      }
+      drawn = Seconds() - start;
+
+      printf("%10ld %6s %14.0f %14.0f\n", n, names[e], n / added,
+	     BENCH_DRAWS * n / drawn);
+      delete rack;
+    }
+
+  TrackLink::MemDestroy();
+  return 0;
+}
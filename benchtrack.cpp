@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "base.h"
+#include "memtrack.h"
+
+/* Times the tracking table under churn: registers n blocks, then
+   forgets and registers them again in a scattered order, finds each,
+   and forgets them all, as aialloc and aifree do.  Each find must give
+   back the block's current link.  Exits nonzero if one doesn't.
+
+   Usage: benchtrack [<most blocks>] */
+
+#define BENCH_FEWEST 10000
+#define BENCH_MOST 10000000
+#define BENCH_BLOCK 16  /* bytes between the blocks registered */
+
+int main(int argc, char *argv[]) {
+  unsigned long most = argc > 1 ? atol(argv[1]) : BENCH_MOST;
+
+  TrackLink::MemInitialize();
+
+  printf("%10s %12s %12s %12s %12s %9s\n", "blocks", "register/s",
+	 "churn/s", "find/s", "forget/s", "total s");
+  for (unsigned long n = BENCH_FEWEST; n <= most; n *= 10) {
+    char *blocks = (char *) malloc(n * BENCH_BLOCK);
+    TrackLink **links = (TrackLink **) malloc(n * sizeof(TrackLink *));
+    double start, registered, churned, found, forgotten;
+
+    if (!blocks || !links) {
+      printf("No room for %ld blocks\n", n);
+      return 1;
+    }
+
+    start = Seconds();
+    for (unsigned long i = 0; i < n; i++)
+      links[i] = TrackLink::MemRegister(blocks + BENCH_BLOCK * i, 0);
+    registered = Seconds() - start;
+
+    /* a multiplicative step, so consecutive blocks land far apart */
+    start = Seconds();
+    for (unsigned long r = 0; r < n; r++) {
+      unsigned long i = (r * 2654435761UL) % n;
+
+      TrackLink::MemForget(links[i]);
+      links[i] = TrackLink::MemRegister(blocks + BENCH_BLOCK * i, 0);
+    }
+    churned = Seconds() - start;
+
+    start = Seconds();
+    for (unsigned long i = 0; i < n; i++)
+      if (TrackLink::MemFindLink(blocks + BENCH_BLOCK * i) != links[i]) {
+	printf("Block %ld of %ld found the wrong link\n", i, n);
+	return 1;
+      }
+    found = Seconds() - start;
+
+    start = Seconds();
+    for (unsigned long i = 0; i < n; i++)
+      TrackLink::MemForget(links[i]);
+    forgotten = Seconds() - start;
+
+    printf("%10ld %12.0f %12.0f %12.0f %12.0f %9.3f\n", n, n / registered,
+	   n / churned, n / found, n / forgotten,
+	   registered + churned + found + forgotten);
+    free(blocks);
+    free(links);
+  }
+
+  TrackLink::MemDestroy();
+  return 0;
+}
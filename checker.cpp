@@ -1,4 +1,5 @@
 #include "checker.h"
+#include "reclaim.h"
 
 CheckWorkspace::CheckWorkspace(Workspace &ws) :
   Codelet(CHKWRK_URGE), workspace(ws) {
@@ -44,7 +45,7 @@ void CheckWorkspace::Execute() {
 	   "checking validity of indices");
 
   /* Put back into coderack */
-  workspace.GetCoderack().AddCodelet(new CheckWorkspace(workspace));
+  Rearm(CHKWRK_URGE);
 }
 
 const char *CheckWorkspace::Class() const {
@@ -88,7 +89,9 @@ void CheckCoderack::Execute() {
   urgesumtype totalurge;
 
   obj = dynamic_cast<AIObject*>(&coderack);
-  aiassert(obj && obj->type == CCoderack, "checking validity of coderack");
+  aiassert(obj && (obj->type == CCoderack || obj->type == CFlatCoderack ||
+		   obj->type == CParallelCoderack),
+	   "checking validity of coderack");
 
   aiassert(coderack.getTotalUrgency() > 0., "checking positive urgency");
 
@@ -101,7 +104,7 @@ void CheckCoderack::Execute() {
   aiassert(coderack.AssertValid(), "valid coderack");
 
   /* Put back into coderack */
-  coderack.AddCodelet(new CheckCoderack(coderack));
+  Rearm(CHKCDR_URGE);
 }
 
 const char *CheckCoderack::Class() const {
@@ -114,7 +117,9 @@ int CheckCoderack::AssertValid() {
   verbize(-2, "assert", "CheckCoderack::AssertValid\n");
 
   obj = dynamic_cast<AIObject*>(&coderack);
-  aiassert(obj && obj->type == CCoderack, "valid coderack");
+  aiassert(obj && (obj->type == CCoderack || obj->type == CFlatCoderack ||
+		   obj->type == CParallelCoderack),
+	   "valid coderack");
 
   return (type == CCheckCoderack);
 }
@@ -139,14 +144,18 @@ CheckMemory::CheckMemory(FILE *fp, Coderack &cr) :
 }
 
 void CheckMemory::Execute() {
-  void *result = TrackLink::MemMarkCheck();
+  void *result;
+
+  /* privileged, so no reader can hold a retired element */
+  EpochReclaimer::Drain();
+  result = TrackLink::MemMarkCheck();
 
   verbize(-3, "debug", "CheckMemory returned %ld\n", result);
 
   aiassert(!result, "memory leaklessness");
 
   /* Put back into coderack */
-  coderack.AddCodelet(new CheckMemory(coderack));
+  Rearm(CHKMEM_URGE);
 }
 
 const char *CheckMemory::Class() const {
@@ -159,7 +168,9 @@ int CheckMemory::AssertValid() {
   verbize(-2, "assert", "CheckMemory::AssertValid\n");
 
   obj = dynamic_cast<AIObject*>(&coderack);
-  aiassert(obj && obj->type == CCoderack, "valid coderack");
+  aiassert(obj && (obj->type == CCoderack || obj->type == CFlatCoderack ||
+		   obj->type == CParallelCoderack),
+	   "valid coderack");
 
   return (type == CCheckMemory);
 }
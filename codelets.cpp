@@ -42,6 +42,19 @@ int Codelet::getFlags() {
   return flags;
 }
 
+void Codelet::Rearm(urgetype urge) {
+  urgency = urge;
+  flags |= REARM_FLAG;
+}
+
+void Codelet::Disarm() {
+  flags &= ~REARM_FLAG;
+}
+
+int Codelet::Cancelled() {
+  return FALSE;
+}
+
 int Codelet::WriteObject(FILE *fp) {
   size_t result = AIObject::WriteObject(fp);
   result = fwrite(&urgency, sizeof(urgetype), 1, fp) + result;
@@ -121,20 +134,15 @@ void ReadKeyboardCodelet::Execute() {
       } else if (bondstr <= 1. - EXP_BOND_MAX)
 	reference_tdiff *= 2;
 
-      lastelt->GetElement().
-	AddBond(new WorkspaceBond(*lastelt, newref, bondstr, DataBond));
+      lastelt->GetElement().AddBond(newref, bondstr, DataBond);
     }
 
     verbize(-5, "debug", "Added Element from keystroke: %c\n", input);
     
     /* now, search for data again */
-    workspace->GetCoderack().
-      AddCodelet(new ReadKeyboardCodelet(&newref, workspace,
-					 (urgetype)
-					 ((workspace->GetCoderack().
-					   getTotalUrgency() - lasturge)
-					  / 4. + .5)));
-					  
+    urgetype urge = (urgetype) ((workspace->GetCoderack().getTotalUrgency() -
+				 lasturge) / 4. + .5);
+
     /* and start a codelet on this */
     if (lastelt) {
       EvolSystemBasic *newsys;
@@ -144,10 +152,13 @@ void ReadKeyboardCodelet::Execute() {
     } else
       workspace->GetCoderack().
 	AddCodelet(new RepeatedCodelet(newref));
+
+    lastelt = &newref;
+    initial = clock();
+    lasturge = urge;
+    Rearm(urge);
   } else
-    workspace->GetCoderack().
-      AddCodelet(new ReadKeyboardCodelet(lastelt, workspace, lasturge,
-					  initial));
+    Rearm(lasturge);
 }
 
 const char *ReadKeyboardCodelet::Class() const {
@@ -302,8 +313,7 @@ void TypeDocumentCodelet::Execute() {
 
   if (recentchar) {
     // Put back on Coderack
-    coderack->AddCodelet(new TypeDocumentCodelet(filesaved, fp, coderack,
-						 getUrgency()));
+    Rearm(getUrgency());
     return;
   }
 
@@ -314,8 +324,7 @@ void TypeDocumentCodelet::Execute() {
     //ungetc(c, stdin);
 
     // Put back on Coderack
-    coderack->AddCodelet(new TypeDocumentCodelet(filesaved, fp, coderack,
-						 TYPEDOC_UINT));
+    Rearm(TYPEDOC_UINT);
 						 //(urgetype)
 						 //((coderack->getTotalUrgency() -
 						 //  getUrgency())
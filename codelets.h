@@ -14,6 +14,7 @@ class Codelet;
 #define EXP_BOND_MAX .75
 
 #define PRIV_FLAG 0x01
+#define REARM_FLAG 0x02  /* stay in the rack after this turn */
 
 /*  codelet base class  */
 class Codelet : public AIObject {
@@ -25,6 +26,15 @@ public:
   urgetype getUrgency();
   urgetype getComplacency();
   int getFlags();
+
+  /* Ask the rack to keep this codelet, at a new urgency, rather than
+     delete it once Execute returns; for codelets that repost themselves */
+  void Rearm(urgetype urge);
+  void Disarm();
+
+  /* TRUE once there's no point running it, so the rack may drop it */
+  virtual int Cancelled();
+
   virtual void Execute() = NULL;
   virtual const char *Class() const = NULL;
   virtual int AssertValid() = NULL;
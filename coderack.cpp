@@ -1,6 +1,22 @@
 #include "coderack.h"
+#include "parrack.h"
 #include <stdlib.h>
 
+int Coderack::engine = TREE_ENGINE;
+unsigned Coderack::workers = 1;
+
+Coderack *Coderack::Create(unsigned long maxsz) {
+  return Create(maxsz, workers);
+}
+
+Coderack *Coderack::Create(unsigned long maxsz, unsigned nworkers) {
+  if (nworkers > 1)
+    return new ParallelCoderack(maxsz, nworkers);
+  if (engine == FLAT_ENGINE)
+    return new FlatCoderack(maxsz);
+  return new Coderack(maxsz);
+}
+
 Coderack::Coderack(unsigned long maxsz) :
   AIObject(CCoderack), maxsize(maxsz) {
   root = new CoderackRoot();
@@ -11,6 +27,16 @@ Coderack::Coderack(unsigned long maxsz) :
   TrackLink::MemStore(trackid, &head, FALSE);
 }
 
+Coderack::Coderack(unsigned long maxsz, classtype t) :
+  AIObject(t), maxsize(maxsz) {
+  root = NULL;
+  head = NULL;
+  size = 0;
+
+  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &head, FALSE);
+}
+
 Coderack::Coderack(FILE *fp) :
   AIObject(fp) {
   fread(&root, sizeof(CoderackRoot *), 1, fp);
@@ -48,6 +74,8 @@ void Coderack::RemoveCodelet() {
     RemoveCodelet();  // don't remove this one
 
   head = todel->Remove()->getRoot(); /* In case select's root is head */
+  if (!head)
+    head = root;
 
   delete todel;
   size--;
@@ -66,13 +94,83 @@ void Coderack::ExecuteCodelet() {
   verbize(-3, "", "Executing codelet %ld: %s\n", torun->getCodelet(),
 	  torun->getCodelet()->Class());
 
-  torun->getCodelet()->Execute();
+  Codelet *cdlet = torun->getCodelet();
+  cdlet->Execute();
+
+  /* Rearmed codelets keep their leaf, just with the new urgency */
+  if (cdlet->getFlags() & REARM_FLAG) {
+    cdlet->Disarm();
+    if (cdlet->getUrgency() > 0.) {
+      torun->updateSummed(cdlet->getUrgency() - torun->getSummed());
+      return;
+    }
+  }
 
   head = torun->Remove()->getRoot(); /* In case select's root is head */
+  if (!head)
+    head = root;  /* ran the last one */
   delete torun;
   size--;
 }
 
+/* The tree has no batch draw; just run them one at a time */
+void Coderack::ExecuteCodelets(unsigned count) {
+  for (unsigned i = 0; i < count; i++)
+    ExecuteCodelet();
+}
+
+Codelet *Coderack::TakeCodelet() {
+  if (!size)
+    return NULL;
+
+  CoderackLeaf *totake = root->SelectWeightLeaf(frand() * root->getSummed());
+
+  if (!totake) {
+    recalcTotalUrgency();
+    return NULL;
+  }
+
+  Codelet *cdlet = totake->ReleaseCodelet();
+
+  head = totake->Remove()->getRoot();
+  if (!head)
+    head = root;  /* took the last one */
+  delete totake;
+  size--;
+
+  return cdlet;
+}
+
+/* Leaves are gathered first, since removing one reshapes the tree */
+unsigned long Coderack::CancelCodelets() {
+  CoderackLeaf **leaves;
+  unsigned long count = 0, cancelled = 0;
+
+  if (!size)
+    return 0;
+  leaves = (CoderackLeaf **) aialloc(size * sizeof(CoderackLeaf *),
+				     "cancelling codelets", 0, -3);
+  if (!leaves)
+    return 0;
+  root->CollectLeaves(leaves, count);
+
+  for (unsigned long i = 0; i < count; i++) {
+    Codelet *cdlet = leaves[i]->getCodelet();
+
+    if ((cdlet->getFlags() & PRIV_FLAG) || !cdlet->Cancelled())
+      continue;
+    head = leaves[i]->Remove()->getRoot();
+    if (!head)
+      head = root;  /* took the last one */
+    delete leaves[i];
+    size--;
+    cancelled++;
+  }
+  aifree(leaves);
+
+  return cancelled;
+}
+
 urgesumtype Coderack::getTotalUrgency() {
   return root->getSummed();
 }
@@ -96,6 +194,14 @@ unsigned long Coderack::getMaxSize() {
   return maxsize;
 }
 
+void Coderack::Quiesce() {
+  // only one thread
+}
+
+void Coderack::Resume() {
+  // only one thread
+}
+
 int Coderack::AssertValid() {
   AIObject *obj;
 
@@ -125,6 +231,389 @@ int Coderack::WriteObject(FILE *fp) {
 
 /**********************/
 
+FlatCoderack::FlatCoderack(unsigned long maxsz) :
+  Coderack(maxsz, CFlatCoderack) {
+  for (capacity = 1; capacity < maxsize; capacity <<= 1);
+  highwater = 0;
+  freecnt = 0;
+
+  summed = (urgesumtype *) aialloc(sizeof(urgesumtype) * 2 * capacity,
+				   "FlatCoderack sum-tree", 1, -1);
+  codelets = (Codelet **) aialloc(sizeof(Codelet *) * capacity,
+				  "FlatCoderack slots", 1, -1);
+  freeslots = (unsigned long *) aialloc(sizeof(unsigned long) * capacity,
+					"FlatCoderack free list", 1, -1);
+  for (unsigned long i = 0; i < 2 * capacity; i++)
+    summed[i] = 0.;
+  for (unsigned long slot = 0; slot < capacity; slot++) {
+    codelets[slot] = NULL;
+    TrackLink::MemStore(trackid, &codelets[slot], FALSE);
+  }
+
+  batchsize = 0;
+  batchselect = NULL;
+  batchslots = NULL;
+
+  TrackLink::MemStore(trackid, &summed, FALSE);
+  TrackLink::MemStore(trackid, &codelets, FALSE);
+  TrackLink::MemStore(trackid, &freeslots, FALSE);
+  TrackLink::MemStore(trackid, &batchselect, FALSE);
+  TrackLink::MemStore(trackid, &batchslots, FALSE);
+}
+
+FlatCoderack::FlatCoderack(FILE *fp) :
+  Coderack(fp) {
+  fread(&capacity, sizeof(unsigned long), 1, fp);
+  fread(&highwater, sizeof(unsigned long), 1, fp);
+  fread(&freecnt, sizeof(unsigned long), 1, fp);
+
+  summed = (urgesumtype *) aialloc(sizeof(urgesumtype) * 2 * capacity,
+				   "FlatCoderack sum-tree", 1, -1);
+  codelets = (Codelet **) aialloc(sizeof(Codelet *) * capacity,
+				  "FlatCoderack slots", 1, -1);
+  freeslots = (unsigned long *) aialloc(sizeof(unsigned long) * capacity,
+					"FlatCoderack free list", 1, -1);
+  fread(summed, sizeof(urgesumtype), 2 * capacity, fp);
+  fread(codelets, sizeof(Codelet *), capacity, fp);
+  fread(freeslots, sizeof(unsigned long), freecnt, fp);
+
+  for (unsigned long slot = 0; slot < capacity; slot++)
+    TrackLink::MemStore(trackid, &codelets[slot], FALSE);
+
+  batchsize = 0;
+  batchselect = NULL;
+  batchslots = NULL;
+
+  TrackLink::MemStore(trackid, &summed, FALSE);
+  TrackLink::MemStore(trackid, &codelets, FALSE);
+  TrackLink::MemStore(trackid, &freeslots, FALSE);
+  TrackLink::MemStore(trackid, &batchselect, FALSE);
+  TrackLink::MemStore(trackid, &batchslots, FALSE);
+}
+
+FlatCoderack::~FlatCoderack() {
+  for (unsigned long slot = 0; slot < highwater; slot++)
+    if (codelets[slot])
+      delete codelets[slot];
+  aifree(summed);
+  aifree(codelets);
+  aifree(freeslots);
+  if (batchselect)
+    aifree(batchselect);
+  if (batchslots)
+    aifree(batchslots);
+}
+
+void FlatCoderack::AddCodelet(Codelet *cdlet) {
+  urgetype urge = cdlet->getUrgency();
+  unsigned long slot;
+
+  verbize(-3, "debug", "Adding Codelet %ld: %s\n", cdlet, cdlet->Class());
+
+  if (urge <= 0.) {
+    delete cdlet;
+    return;
+  }
+
+  if (size >= maxsize)
+    RemoveCodelet();
+  if (size >= maxsize) {
+    verbize(-2, "debug", "Nothing to evict for %s; dropping it\n",
+	    cdlet->Class());
+    delete cdlet;
+    return;
+  }
+
+  if (freecnt)
+    slot = freeslots[--freecnt];
+  else
+    slot = highwater++;
+  codelets[slot] = cdlet;
+  SetSlot(slot, urge);
+  size++;
+}
+
+/* Only called on a full rack, so nearly every draw is evictable; if a
+   few draws miss, a scan from a random slot settles it, and may find
+   nothing but privileged, executing and held codelets */
+void FlatCoderack::RemoveCodelet() {
+  unsigned long slot, start;
+
+  if (!size)
+    return;
+
+  for (unsigned tries = 0; tries < FLAT_REMOVE_TRIES; tries++) {
+    slot = irand(highwater);
+    if (Evictable(slot)) {
+      delete DetachSlot(slot);
+      return;
+    }
+  }
+
+  start = irand(highwater);
+  for (unsigned long i = 0; i < highwater; i++) {
+    slot = (start + i) % highwater;
+    if (Evictable(slot)) {
+      delete DetachSlot(slot);
+      return;
+    }
+  }
+}
+
+void FlatCoderack::ExecuteCodelet() {
+  verbize(-8, "debug", "Beginning ExecuteCodelet\n");
+
+  if (summed[1] <= 0.) {
+    recalcTotalUrgency();
+    return;
+  }
+
+  unsigned long slot = SelectWeightSlot(frand() * summed[1]);
+  Codelet *torun = codelets[slot];
+
+  verbize(-3, "", "Executing codelet %ld: %s\n", torun, torun->Class());
+
+  /* Leave it in its slot (and so reachable) while running, but with no
+     urgency, so it can't be drawn or evicted by codelets it adds */
+  SetSlot(slot, 0.);
+  try {
+    torun->Execute();
+  } catch (...) {
+    delete DetachSlot(slot);
+    throw;
+  }
+
+  RetireSlot(slot);
+}
+
+/* Slots without urgency are executing, and left alone */
+unsigned long FlatCoderack::CancelCodelets() {
+  unsigned long cancelled = 0;
+
+  for (unsigned long slot = 0; slot < highwater; slot++)
+    if (codelets[slot] && summed[capacity + slot] > 0. &&
+	!(codelets[slot]->getFlags() & PRIV_FLAG) &&
+	codelets[slot]->Cancelled()) {
+      delete DetachSlot(slot);
+      cancelled++;
+    }
+
+  return cancelled;
+}
+
+Codelet *FlatCoderack::TakeCodelet() {
+  if (!size)
+    return NULL;
+  if (summed[1] <= 0.) {
+    recalcTotalUrgency();
+    return NULL;
+  }
+
+  return DetachSlot(SelectWeightSlot(frand() * summed[1]));
+}
+
+/* Systematic sampling: one uniform offset, then count evenly spaced
+   selects across the total urgency, so each codelet is drawn with
+   probability proportional to its urgency (a codelet heavier than the
+   spacing is drawn once, not several times).  All are held out of the
+   tree in a single descent, then run in order. */
+void FlatCoderack::ExecuteCodelets(unsigned count) {
+  unsigned found, i;
+
+  verbize(-8, "debug", "Beginning ExecuteCodelets (%d)\n", count);
+
+  if (count <= 1) {
+    ExecuteCodelet();
+    return;
+  }
+
+  if (summed[1] <= 0.) {
+    recalcTotalUrgency();
+    return;
+  }
+
+  if (count > batchsize) {
+    batchselect = (urgesumtype *) airealloc(batchselect,
+					    sizeof(urgesumtype) * count,
+					    "FlatCoderack batch selects",
+					    1, -2);
+    batchslots = (unsigned long *) airealloc(batchslots,
+					     sizeof(unsigned long) * count,
+					     "FlatCoderack batch slots",
+					     1, -2);
+    batchsize = count;
+  }
+
+  urgesumtype spacing = summed[1] / count;
+  urgesumtype offset = frand() * spacing;
+  for (i = 0; i < count; i++)
+    batchselect[i] = offset + i * spacing;
+
+  found = HoldWeightSlots(1, batchselect, count, batchslots);
+
+  for (i = 0; i < found; i++) {
+    Codelet *torun = codelets[batchslots[i]];
+
+    verbize(-3, "", "Executing codelet %ld: %s\n", torun, torun->Class());
+
+    try {
+      torun->Execute();
+    } catch (...) {
+      /* put back those that haven't had their turn */
+      for (unsigned j = i + 1; j < found; j++)
+	SetSlot(batchslots[j], codelets[batchslots[j]]->getUrgency());
+      delete DetachSlot(batchslots[i]);
+      throw;
+    }
+
+    RetireSlot(batchslots[i]);
+  }
+}
+
+urgesumtype FlatCoderack::getTotalUrgency() {
+  return summed[1];
+}
+
+void FlatCoderack::recalcTotalUrgency() {
+  for (unsigned long node = capacity - 1; node > 0; node--)
+    summed[node] = summed[2 * node] + summed[2 * node + 1];
+}
+
+void FlatCoderack::print() {
+  printf("Flat rack %ld (%f); Size is %ld of %ld in %ld slots.\n", this,
+	 summed[1], size, maxsize, capacity);
+  for (unsigned long slot = 0; slot < highwater; slot++)
+    if (codelets[slot])
+      printf("%ld (%f): %ld\n", slot, summed[capacity + slot],
+	     codelets[slot]);
+}
+
+int FlatCoderack::AssertValid() {
+  AIObject *obj;
+  unsigned long used = 0;
+
+  for (unsigned long node = 1; node < capacity; node++)
+    aiassert(summed[node] == summed[2 * node] + summed[2 * node + 1],
+	     "checking sums of flat coderack");
+
+  for (unsigned long slot = 0; slot < capacity; slot++) {
+    if (codelets[slot]) {
+      obj = dynamic_cast<AIObject*>(codelets[slot]);
+      aiassert(obj && codelets[slot]->AssertValid(),
+	       "checking validity of codelet");
+      used++;
+    } else
+      aiassert(summed[capacity + slot] == 0., "checking empty slot");
+  }
+  aiassert(used == size, "checking size of flat coderack");
+
+  for (unsigned long i = 0; i < freecnt; i++)
+    aiassert(freeslots[i] < highwater && !codelets[freeslots[i]],
+	     "checking free slot list");
+  aiassert(used + freecnt == highwater, "checking slots are accounted for");
+
+  return (type == CFlatCoderack);
+}
+
+int FlatCoderack::WriteObject(FILE *fp) {
+  size_t result = Coderack::WriteObject(fp);
+  result = fwrite(&capacity, sizeof(unsigned long), 1, fp) + result;
+  result = fwrite(&highwater, sizeof(unsigned long), 1, fp) + result;
+  result = fwrite(&freecnt, sizeof(unsigned long), 1, fp) + result;
+  result = fwrite(summed, sizeof(urgesumtype), 2 * capacity, fp) + result;
+  result = fwrite(codelets, sizeof(Codelet *), capacity, fp) + result;
+  return fwrite(freeslots, sizeof(unsigned long), freecnt, fp) + result;
+}
+
+/* Walk down from the root, never into a zero-urgency subtree */
+unsigned long FlatCoderack::SelectWeightSlot(urgesumtype select) {
+  unsigned long node = 1;
+
+  verbize(-8, "debug", "In SWS for flat rack %ld: %f\n", this, select);
+  while (node < capacity) {
+    node <<= 1;
+    if (select >= summed[node] && summed[node + 1] > 0.) {
+      select -= summed[node];
+      node++;
+    }
+  }
+  return node - capacity;
+}
+
+/* Split the sorted selects between node's children, zero the urgency of
+   each leaf reached (several selects may share one), and rebuild the sums
+   on the way back up.  Returns the number of slots put in slots. */
+unsigned FlatCoderack::HoldWeightSlots(unsigned long node,
+				       urgesumtype *select, unsigned count,
+				       unsigned long *slots) {
+  unsigned left, found = 0;
+
+  if (node >= capacity) {
+    slots[0] = node - capacity;
+    summed[node] = 0.;
+    return 1;
+  }
+
+  urgesumtype leftsum = summed[2 * node];
+  for (left = 0; left < count && (select[left] < leftsum ||
+				  summed[2 * node + 1] <= 0.); left++);
+
+  if (left)
+    found = HoldWeightSlots(2 * node, select, left, slots);
+  if (left < count) {
+    for (unsigned i = left; i < count; i++)
+      select[i] -= leftsum;
+    found += HoldWeightSlots(2 * node + 1, select + left, count - left,
+			     slots + found);
+  }
+
+  summed[node] = summed[2 * node] + summed[2 * node + 1];
+  return found;
+}
+
+/* Sums are rebuilt from the children, so no error accumulates */
+void FlatCoderack::SetSlot(unsigned long slot, urgetype urge) {
+  unsigned long node = capacity + slot;
+
+  summed[node] = urge;
+  for (node >>= 1; node; node >>= 1)
+    summed[node] = summed[2 * node] + summed[2 * node + 1];
+}
+
+/* After its turn, a codelet either goes back in its slot or is freed */
+/* A slot with no urgency is executing or held in a batch */
+int FlatCoderack::Evictable(unsigned long slot) {
+  return codelets[slot] && summed[capacity + slot] > 0. &&
+    !(codelets[slot]->getFlags() & PRIV_FLAG);
+}
+
+void FlatCoderack::RetireSlot(unsigned long slot) {
+  Codelet *done = codelets[slot];
+
+  if (done->getFlags() & REARM_FLAG) {
+    done->Disarm();
+    if (done->getUrgency() > 0.) {
+      SetSlot(slot, done->getUrgency());
+      return;
+    }
+  }
+
+  delete DetachSlot(slot);
+}
+
+Codelet *FlatCoderack::DetachSlot(unsigned long slot) {
+  Codelet *cdlet = codelets[slot];
+
+  codelets[slot] = NULL;
+  if (summed[capacity + slot] != 0.)
+    SetSlot(slot, 0.);
+  freeslots[freecnt++] = slot;
+  size--;
+  return cdlet;
+}
+
+/**********************/
+
 CoderackNode::CoderackNode() :
   AIObject(CCoderackNode) {
   TrackLink::MemStore(trackid, &root, FALSE);
@@ -247,6 +736,12 @@ CoderackLeaf *CoderackBranch::SelectWeightLeaf(urgesumtype select) {
   return child[i]->SelectWeightLeaf(select);
 }
 
+void CoderackBranch::CollectLeaves(CoderackLeaf **leaves,
+				   unsigned long &count) {
+  for (int i = 0; i < childcnt; i++)
+    child[i]->CollectLeaves(leaves, count);
+}
+
 void CoderackBranch::print() {
   printf("%ld (%f): %ld; ", this, summed, root);
   for (int i = 0; i < childcnt; i++)
@@ -326,6 +821,7 @@ CoderackNode *CoderackRoot::AddBranch(CoderackNode *branch) {
     child = branch;
     branch->setRoot(this);
     summed = branch->getSummed();
+    return this;
   }
 }
 
@@ -351,13 +847,19 @@ CoderackLeaf *CoderackRoot::SelectWeightLeaf(urgesumtype select) {
   return child->SelectWeightLeaf(select);
 }
 
+void CoderackRoot::CollectLeaves(CoderackLeaf **leaves,
+				 unsigned long &count) {
+  if (child && child != this)
+    child->CollectLeaves(leaves, count);
+}
+
 void CoderackRoot::print() {
   printf("%ld (%f): %ld\n", this, summed, child);
   child->print();
 }
 
 void CoderackRoot::recalcSummed() {
-  if (child) {
+  if (child && child != this) {  /* an empty root points to itself */
     child->recalcSummed();
     summed = child->getSummed();
   } else
@@ -435,6 +937,11 @@ CoderackLeaf *CoderackLeaf::SelectWeightLeaf(urgesumtype select) {
   return this;
 }
 
+void CoderackLeaf::CollectLeaves(CoderackLeaf **leaves,
+				 unsigned long &count) {
+  leaves[count++] = this;
+}
+
 void CoderackLeaf::print() {
   printf("%ld (%f): Leaf\n", this, summed);
 }
@@ -453,6 +960,12 @@ Codelet *CoderackLeaf::getCodelet() {
   return codelet;
 }
 
+Codelet *CoderackLeaf::ReleaseCodelet() {
+  Codelet *cdlet = codelet;
+  codelet = NULL;
+  return cdlet;
+}
+
 int CoderackLeaf::AssertValidChildren(CoderackNode *head) {
   AIObject *obj;
 
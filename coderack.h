@@ -7,6 +7,8 @@ typedef float urgetype;
 typedef double urgesumtype;
 
 class Coderack;
+class FlatCoderack;
+class ParallelCoderack;
 class CoderackNode;
 class CoderackBranch;
 class CoderackRoot;
@@ -15,31 +17,99 @@ class CoderackLeaf;
 #include "base.h"
 #include "codelets.h"
 
+/* Coderack engines, chosen by Coderack::engine when a rack is created */
+#define TREE_ENGINE 0  /* 2-3 tree of CoderackNodes */
+#define FLAT_ENGINE 1  /* array sum-tree of urgencies (FlatCoderack) */
+
+#define FLAT_REMOVE_TRIES 64  /* random draws to evict before a scan */
+
 /*  coderack structure  */
 class Coderack : public AIObject {
 public:
   Coderack(unsigned long maxsz);
   Coderack(FILE *fp);
-  ~Coderack();
-
-  void RemoveCodelet();
-  void AddCodelet(Codelet *codelet);  // -codelet
-  void ExecuteCodelet();
-  urgesumtype getTotalUrgency();
-  void recalcTotalUrgency();
-  void print();
-  unsigned long getSize();  // the current size
+  virtual ~Coderack();
+
+  static Coderack *Create(unsigned long maxsz);  // + rack of current engine
+  static Coderack *Create(unsigned long maxsz, unsigned nworkers); // +
+
+  virtual void RemoveCodelet();
+  virtual void AddCodelet(Codelet *codelet);  // -codelet
+  virtual void ExecuteCodelet();
+  virtual void ExecuteCodelets(unsigned count);
+  virtual Codelet *TakeCodelet();  // + weighted draw, not executed
+  virtual unsigned long CancelCodelets();  // drops those Cancelled()
+  virtual urgesumtype getTotalUrgency();
+  virtual void recalcTotalUrgency();
+  virtual void print();
+  virtual unsigned long getSize();  // the current size
   unsigned long getMaxSize();
 
-  int AssertValid();
+  /* Stop and restart any other threads running codelets from this rack */
+  virtual void Quiesce();
+  virtual void Resume();
+
+  virtual int AssertValid();
 
   virtual int WriteObject(FILE *fp);
 
+  static int engine;
+  static unsigned workers;  /* > 1 for a ParallelCoderack */
+
+protected:
+  Coderack(unsigned long maxsz, classtype t);  // no tree, for other engines
+
+  unsigned long size;
+  unsigned long maxsize;
+
 private:
   CoderackRoot *root;
   CoderackNode *head;
-  unsigned long size;
-  unsigned long maxsize;
+};
+
+/* Coderack kept as a sum-tree over a flat array of slots: node i holds
+   the summed urgency of nodes 2i and 2i+1, and slot s is the leaf at
+   capacity + s.  Empty slots have zero urgency and sit on a free list. */
+class FlatCoderack : public Coderack {
+public:
+  FlatCoderack(unsigned long maxsz);
+  FlatCoderack(FILE *fp);
+  ~FlatCoderack();
+
+  virtual void RemoveCodelet();
+  virtual void AddCodelet(Codelet *codelet);  // -codelet
+  virtual void ExecuteCodelet();
+  virtual void ExecuteCodelets(unsigned count);
+  virtual Codelet *TakeCodelet();  // +
+  virtual unsigned long CancelCodelets();
+  virtual urgesumtype getTotalUrgency();
+  virtual void recalcTotalUrgency();
+  virtual void print();
+
+  virtual int AssertValid();
+
+  virtual int WriteObject(FILE *fp);
+
+protected:
+  unsigned long SelectWeightSlot(urgesumtype select);
+  unsigned HoldWeightSlots(unsigned long node, urgesumtype *select,
+			   unsigned count, unsigned long *slots);
+  void SetSlot(unsigned long slot, urgetype urge);
+  Codelet *DetachSlot(unsigned long slot);
+  void RetireSlot(unsigned long slot);
+  int Evictable(unsigned long slot);
+
+  unsigned long capacity;  /* leaves in the sum-tree, a power of 2 */
+  unsigned long highwater;  /* slots below this have been used */
+  unsigned long freecnt;
+
+  urgesumtype *summed;  /* 2 * capacity sums, root at 1 */
+  Codelet **codelets;  /* capacity slots */
+  unsigned long *freeslots;  /* stack of freecnt empty slots */
+
+  unsigned batchsize;  /* room in the buffers below */
+  urgesumtype *batchselect;
+  unsigned long *batchslots;
 };
 
 class CoderackNode : public AIObject {
@@ -53,6 +123,10 @@ public:
   virtual CoderackLeaf *SelectWeightLeaf(urgesumtype select) = NULL;
   virtual void print() = NULL;
 
+  /* Appends every leaf below to leaves, which has room for them */
+  virtual void CollectLeaves(CoderackLeaf **leaves,
+			     unsigned long &count) = NULL;
+
   void updateSummed(urgetype delta);
   urgesumtype getSummed();
   virtual void recalcSummed() = NULL;
@@ -80,6 +154,7 @@ public:
   virtual CoderackLeaf *SelectRandomLeaf(float select);
   virtual CoderackLeaf *SelectWeightLeaf(urgesumtype select);
   virtual void print();
+  virtual void CollectLeaves(CoderackLeaf **leaves, unsigned long &count);
 
   virtual void recalcSummed();
 
@@ -103,6 +178,7 @@ public:
   virtual CoderackLeaf *SelectRandomLeaf(float select);
   virtual CoderackLeaf *SelectWeightLeaf(urgesumtype select);
   virtual void print();
+  virtual void CollectLeaves(CoderackLeaf **leaves, unsigned long &count);
 
   virtual void recalcSummed();
 
@@ -125,12 +201,14 @@ public:
   virtual CoderackLeaf *SelectRandomLeaf(float select);
   virtual CoderackLeaf *SelectWeightLeaf(urgesumtype select);
   virtual void print();
+  virtual void CollectLeaves(CoderackLeaf **leaves, unsigned long &count);
 
   virtual void recalcSummed();
 
   CoderackNode *Remove();
 
   Codelet *getCodelet();
+  Codelet *ReleaseCodelet();  // + leaf no longer deletes it
 
   virtual int AssertValidChildren(CoderackNode *head);
 
@@ -1,6 +1,7 @@
 #include <math.h>
 #include <ctype.h>
 #include "evolet.h"
+#include "population.h"
 
 extern float effectiveness;
 extern unsigned long predtotal;
@@ -10,7 +11,7 @@ extern unsigned long predtotal;
 QueueCodelet::QueueCodelet(EvolSystemPtr sys, WorkspaceRef &ref) :
   Codelet(UrgeRange * sys->Credibility()), location(ref) {
   type = CQueueCodelet;
-  system = sys;
+  system.Swap(sys);
 
   TrackLink::MemStore(trackid, &location, CONST_FLAG);
   TrackLink::MemStore(trackid, system.GetSystemPP(), FALSE);
@@ -45,6 +46,10 @@ void QueueCodelet::Execute() {
   }
 }
 
+int QueueCodelet::Cancelled() {
+  return system->Culled();
+}
+
 const char *QueueCodelet::Class() const {
   return "QueueCodelet";
 }
@@ -87,7 +92,7 @@ EvolaiCodelet::EvolaiCodelet(FILE *fp, WorkspaceRef &ref) :
 }
 
 void EvolaiCodelet::Execute() {
-  WorkspaceElt &elt(location.GetElement());
+  WorkspaceElt &elt(location.UseElement());
   EvolSystemPtr system = elt.RemoveQueue();
   if (system.GetSystem()) {
     verbize(-8, "debug", "Got System %ld:%d\n", system.GetSystem(),
@@ -128,7 +133,7 @@ MoveSystemCodelet::MoveSystemCodelet(WorkspaceRef &curr, EvolSystemPtr sys,
   type = CMoveSystemCodelet;
   verbize(-6, "debug", "Creating MoveSystemCodelet %ld with %ld (%f)\n", this,
 	  sys.GetSystem(), sys->Credibility());
-  system = sys;
+  system.Swap(sys);
   prediction = pred;
 
   TrackLink::MemStore(trackid, &currloc, CONST_FLAG);
@@ -148,10 +153,14 @@ MoveSystemCodelet::~MoveSystemCodelet() {
 }
 
 void MoveSystemCodelet::Execute() {
-  WorkspaceBond *dir = currloc.BorrowElement().SelectWeightBond();
+  if (Cancelled())
+    return;
+
+  WorkspaceElt &here = currloc.UseElement();
+  int dir = here.SelectWeightBond();
   EvolSystemPtr child;
 
-  if (!dir) { // nothing to do yet
+  if (dir == NO_BOND) { // nothing to do yet
     if (isprint(prediction)) {
       verbize(-2, "status", "Input Prediction (%ld): %c\n", currloc.GetLocation(), prediction);
       printf("(%c)", prediction);
@@ -160,15 +169,15 @@ void MoveSystemCodelet::Execute() {
       verbize(-2, "status", "Input Prediction (%ld): %d\n", currloc.GetLocation(), prediction);
     currloc.GetWorkspace()->GetCoderack().
       AddCodelet(new MoveSystemCodelet(currloc, system, prediction));
-  } else if (prediction == dir->To().BorrowElement().GetValue()) {
+  } else if (prediction == here.GetBond(dir).To().BorrowElement().GetValue()) {
     verbize(-6, "debug", "Executing correct prediction\n");
     effectiveness += 1.;
     predtotal++;
-    dir->Strengthen(system->Credibility());
+    here.StrengthenBond(dir, system->Credibility());
     system->PredSuccess();
     /* move along */
     currloc.GetWorkspace()->GetCoderack().
-      AddCodelet(new QueueCodelet(system, dir->To()));
+      AddCodelet(new QueueCodelet(system, here.GetBond(dir).To()));
     /* reproduce the system */
     child = system->reproduce(REPRO_PRISTINE);
     if (child.GetSystem()) {
@@ -177,22 +186,23 @@ void MoveSystemCodelet::Execute() {
 	AddCodelet(new QueueCodelet(child, currloc));
     }
   } else {
-    verbize(-7, "debug", "Executing Else Case (%ld, %ld)\n", dir,
+    verbize(-7, "debug", "Executing Else Case (%d, %ld)\n", dir,
 	    system.GetSystem());
-    dir->Weaken(system->Credibility());
+    here.WeakenBond(dir, system->Credibility());
     if (ProbToBool(sqrt(system->Credibility()))) { /* do we know what doing? */
       effectiveness -= .5;
       predtotal++;
-      system->Weaken(Confidence(sqr(dir->GetStrength()))); /* don't week much for re-move */
+      system->Weaken(Confidence(sqr(here.GetBond(dir).GetStrength()))); /* don't week much for re-move */
       currloc.GetWorkspace()->GetCoderack().
 	AddCodelet(new MoveSystemCodelet(currloc, system, prediction));
     } else if (ProbToBool(system->Credibility())) {
       verbize(-6, "debug", "Executing excused for jump\n");
       effectiveness -= .1;
       predtotal++;
-      system->Weaken(Confidence(dir->GetStrength())); /* weaken move for jump */
+      system->Weaken(Confidence(here.GetBond(dir).GetStrength())); /* weaken move for jump */
       currloc.GetWorkspace()->GetCoderack().
-	AddCodelet(new JumpSystemCodelet(dir->To(), system, prediction));
+	AddCodelet(new JumpSystemCodelet(here.GetBond(dir).To(), system,
+					 prediction));
     } else {
       verbize(-6, "debug", "Executing unexcused failure\n");
       effectiveness -= 1.;
@@ -212,11 +222,15 @@ void MoveSystemCodelet::Execute() {
 					   prediction));
       } else
 	currloc.GetWorkspace()->GetCoderack().
-	  AddCodelet(new QueueCodelet(system, dir->To()));
+	  AddCodelet(new QueueCodelet(system, here.GetBond(dir).To()));
     }
   }
 }
 
+int MoveSystemCodelet::Cancelled() {
+  return system->Culled();
+}
+
 const char *MoveSystemCodelet::Class() const {
   return "MoveSystemCodelet";
 }
@@ -250,7 +264,7 @@ JumpSystemCodelet::JumpSystemCodelet(WorkspaceRef &curr, EvolSystemPtr sys,
 				     char pred) :
   Codelet(UrgeRange * sys->Credibility()), currloc(curr) {
   type = CJumpSystemCodelet;
-  system = sys;
+  system.Swap(sys);
   prediction = pred;
 
   TrackLink::MemStore(trackid, &currloc, CONST_FLAG);
@@ -270,33 +284,36 @@ JumpSystemCodelet::~JumpSystemCodelet() {
 }
 
 void JumpSystemCodelet::Execute() {
-  int spacing = currloc.GetWorkspace()->GetCurrentIndex() / 256 + 1;
-
-  for (unsigned long i = irand(spacing);
-       i < currloc.GetWorkspace()->GetCurrentIndex();
-       i += irand(spacing) + 1) {
-    if (currloc.GetWorkspace()->SalientElement(i).BorrowElement().GetValue() == prediction) {
-      if (i == currloc.BorrowElement().GetSalientLoc().GetLocation())
-	continue;
-      
-      WorkspaceElt &elt = currloc.GetElement();
-
-      system->PredSuccess();
-      /* Add new bond to this */
-      elt.AddBond(currloc.GetWorkspace()->SalientElement(i),
-		  JUMP_STR, EvolaiBond);
-      elt.Commit();
-      /* Continue execution at that location */
-      currloc.GetWorkspace()->GetCoderack().
-	AddCodelet(new QueueCodelet(system, currloc.GetWorkspace()->SalientElement(i)));
-      return;
-    }
+  CNIndex i;
+
+  if (Cancelled())
+    return;
+
+  if (currloc.GetWorkspace()->
+      SalientWithValue(prediction,
+		       currloc.BorrowElement().GetSalientLoc().GetLocation(),
+		       &i)) {
+    WorkspaceElt &elt = currloc.GetElement();
+
+    system->PredSuccess();
+    /* Add new bond to this */
+    elt.AddBond(currloc.GetWorkspace()->SalientElement(i),
+		JUMP_STR, EvolaiBond);
+    elt.Commit();  /* edited in place, so nothing is copied */
+    /* Continue execution at that location */
+    currloc.GetWorkspace()->GetCoderack().
+      AddCodelet(new QueueCodelet(system, currloc.GetWorkspace()->SalientElement(i)));
+    return;
   }
   /* nothing was found, try again */
   currloc.GetWorkspace()->GetCoderack().
     AddCodelet(new MoveSystemCodelet(currloc, system, prediction));
 }
 
+int JumpSystemCodelet::Cancelled() {
+  return system->Culled();
+}
+
 const char *JumpSystemCodelet::Class() const {
   return "JumpSystemCodelet";
 }
@@ -327,10 +344,7 @@ int JumpSystemCodelet::WriteObject(FILE *fp) {
 /***************************************************************/
 
 RepeatedCodelet::RepeatedCodelet(WorkspaceRef &ref) :
-  Codelet(UrgeRange /
-	  (float) (ref.GetWorkspace()->GetCurrentIndex() *
-		   ref.GetWorkspace()->GetCoderack().getSize())), 
-  location(ref) {
+  Codelet(Urgency(ref)), location(ref) {
   type = CRepeatedCodelet;
 
   TrackLink::MemStore(trackid, &location, CONST_FLAG);
@@ -351,8 +365,13 @@ void RepeatedCodelet::Execute() {
   location.GetWorkspace()->GetCoderack().
     AddCodelet(new QueueCodelet(newsys = new EvolSystemBasic(), location));
   newsys->mutate();
-  location.GetWorkspace()->GetCoderack().
-    AddCodelet(new RepeatedCodelet(location));
+  Rearm(Urgency(location));
+}
+
+/* Spread evenly over the workspace's elements and the rack's codelets */
+urgetype RepeatedCodelet::Urgency(WorkspaceRef &ref) {
+  return UrgeRange / (float) (ref.GetWorkspace()->GetCurrentIndex() *
+			      ref.GetWorkspace()->GetCoderack().getSize());
 }
 
 const char *RepeatedCodelet::Class() const {
@@ -376,3 +395,60 @@ int RepeatedCodelet::WriteObject(FILE *fp) {
   size_t result = Codelet::WriteObject(fp);
   return fwrite(&wr, sizeof(WorkspaceRef *), 1, fp) + result;
 }
+
+/***************************************************************/
+
+CullSystemsCodelet::CullSystemsCodelet(Workspace &ws) :
+  Codelet(CULL_URGE), workspace(ws) {
+  type = CCullSystemsCodelet;
+  flags |= PRIV_FLAG;
+  TrackLink::MemStore(trackid, &workspace, CONST_FLAG);
+}
+
+CullSystemsCodelet::CullSystemsCodelet(FILE *fp, Workspace &ws) :
+  Codelet(fp), workspace(ws) {
+  TrackLink::MemStore(trackid, &workspace, CONST_FLAG);
+}
+
+/* Culled systems linger until whatever holds them lets go, so their
+   codelets are swept for as long as any remain.  Codelets go to the
+   rack of their element's level, so every level's rack is swept; the
+   cull itself runs once, so a tower culls no faster than one level. */
+void CullSystemsCodelet::Execute() {
+  unsigned long cancelled = 0;
+
+  SystemPopulation::Cull();
+  if (SystemPopulation::GetCulledCount()) {
+    for (Workspace *ws = &workspace; ws; ws = ws->GetLowerWorkspace())
+      cancelled += ws->GetCoderack().CancelCodelets();
+    verbize(-3, "debug", "Cancelled %ld codelets of culled systems\n",
+	    cancelled);
+  }
+
+  /* Put back into coderack */
+  Rearm(CULL_URGE);
+}
+
+const char *CullSystemsCodelet::Class() const {
+  return "CullSystemsCodelet";
+}
+
+int CullSystemsCodelet::AssertValid() {
+  AIObject *obj;
+
+  verbize(-2, "assert", "CullSystemsCodelet::AssertValid\n");
+
+  obj = dynamic_cast<AIObject*>(&workspace);
+  aiassert(obj && (obj->type == CMemoryWorkspace ||
+		   obj->type == CBigEndianWorkspace ||
+		   obj->type == CLittleEndianWorkspace), "valid workspace");
+
+  return (type == CCullSystemsCodelet);
+}
+
+int CullSystemsCodelet::WriteObject(FILE *fp) {
+  Workspace *ws = &workspace;
+
+  size_t result = fwrite(&ws, sizeof(Workspace *), 1, fp);
+  return Codelet::WriteObject(fp) + result;
+}
@@ -3,6 +3,7 @@
 
 #define REPRO_PRISTINE .5
 #define JUMP_STR .25
+#define CULL_URGE .1
 
 #include "codelets.h"
 
@@ -16,6 +17,7 @@ public:
   virtual void Execute();
   virtual const char *Class() const;
   virtual int AssertValid();
+  virtual int Cancelled();  // once its system is culled
 
   virtual int WriteObject(FILE *fp);
 
@@ -50,6 +52,7 @@ public:
   virtual void Execute();
   virtual const char *Class() const;
   virtual int AssertValid();
+  virtual int Cancelled();
 
   virtual int WriteObject(FILE *fp);
 
@@ -69,6 +72,7 @@ public:
   virtual void Execute();
   virtual const char *Class() const;
   virtual int AssertValid();
+  virtual int Cancelled();
 
   virtual int WriteObject(FILE *fp);
 
@@ -92,7 +96,27 @@ public:
   virtual int WriteObject(FILE *fp);
 
 private:
+  static urgetype Urgency(WorkspaceRef &ref);
+
   WorkspaceRef &location;
 };
 
+/* Holds the population to SystemPopulation::budget, culling the least
+   credible systems and cancelling the codelets that carry them on
+   every level of its workspace's tower */
+class CullSystemsCodelet : public Codelet {
+public:
+  CullSystemsCodelet(Workspace &ws);
+  CullSystemsCodelet(FILE *fp, Workspace &ws);
+
+  virtual void Execute();
+  virtual const char *Class() const;
+  virtual int AssertValid();
+
+  virtual int WriteObject(FILE *fp);
+
+private:
+  Workspace &workspace;
+};
+
 #endif
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include "base.h"
+#include "jit.h"
+
+/* Registers while in native code:
+     rdi  the JitState         rsi  datl
+     cl   accu                 rdx  dna
+     r8   dnalen               r9   budget
+     r10  the opcode table     eax  scratch, then the position to resume at */
+
+typedef unsigned (*NativeCode)(JitState *state, void *at);
+
+unsigned long GenomeCode::compiled = 0;
+
+GenomeCode::GenomeCode() {
+  code = NULL;
+  size = used = 0;
+  count = 0;
+  jumps = NULL;
+  jumpcount = 0;
+}
+
+GenomeCode::~GenomeCode() {
+  if (code)
+    munmap(code, size);
+  free(jumps);
+}
+
+GenomeCode *GenomeCode::Compile(const unsigned char *ops, unsigned count,
+				const unsigned char *dna, unsigned dnalen) {
+#if defined(__x86_64__)
+  GenomeCode *native = new GenomeCode();
+  unsigned char **table;
+  unsigned *exits;
+  unsigned at, skip;
+  void *mem;
+
+  native->count = count;
+  native->size = count * sizeof(void *) + (count + 2) * JIT_OP_BYTES;
+  mem = mmap(NULL, native->size, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  native->jumps = (unsigned *) malloc(2 * (3 * count + 1) * sizeof(unsigned));
+  if (mem == MAP_FAILED || !native->jumps) {
+    verbize(-3, "debug", "No room to compile genome of %d opcodes\n", count);
+    if (mem != MAP_FAILED)
+      munmap(mem, native->size);
+    delete native;
+    return NULL;
+  }
+  native->code = (unsigned char *) mem;
+  table = (unsigned char **) mem;
+  native->used = count * sizeof(void *);
+
+  /* Load the registers, then go to the opcode asked for */
+  native->Emit("\x48\x89\xf0", 3);			/* mov rax, rsi */
+  native->Emit("\x48\x8b\x77", 3);			/* mov rsi, datl */
+  native->EmitByte(offsetof(JitState, datl));
+  native->Emit("\x4c\x8b\x4f", 3);			/* mov r9, budget */
+  native->EmitByte(offsetof(JitState, budget));
+  native->Emit("\x0f\xb6\x4f", 3);			/* movzx ecx, accu */
+  native->EmitByte(offsetof(JitState, accu));
+  native->Emit("\x48\xba", 2);				/* mov rdx, dna */
+  native->EmitWord((unsigned long) dna);
+  native->EmitWord((unsigned long) dna >> 32);
+  native->Emit("\x49\xb8", 2);				/* mov r8, dnalen */
+  native->EmitWord(dnalen);
+  native->EmitWord(0);
+  native->Emit("\xff\xe0", 2);				/* jmp rax */
+
+  for (at = 0; at < count; at++) {
+    table[at] = native->code + native->used;
+
+    if (ops[at] == 2) {  /* writes change the genome under us */
+      native->EmitJump("\xe9", 1, at);			/* jmp exit */
+      continue;
+    }
+
+    native->Emit("\x4d\x85\xc9", 3);			/* test r9, r9 */
+    native->EmitJump("\x0f\x84", 2, at);		/* jz exit */
+    if (ops[at] == 0) {
+      native->Emit("\x84\xc9\x74\x00", 4);		/* test cl, cl; jz on */
+      skip = native->used;
+      native->Emit("\x48\x81\xfe", 3);		/* cmp rsi, length */
+      native->EmitWord(count / 2);
+      native->EmitJump("\x0f\x83", 2, at);		/* jae exit */
+      native->Emit("\x49\xff\xc9", 3);		/* dec r9 */
+      if ((at + 1) % 2)
+	native->Emit("\x48\x8d\x44\x36\x01", 5);	/* lea rax, [2 * rsi + 1] */
+      else
+	native->Emit("\x48\x8d\x04\x36", 4);	/* lea rax, [2 * rsi] */
+      native->EmitByte(0xbe);				/* mov esi, dnal */
+      native->EmitWord((at + 1) / 2);
+      native->Emit("\x49\xba", 2);			/* mov r10, table */
+      native->EmitWord((unsigned long) table);
+      native->EmitWord((unsigned long) table >> 32);
+      native->Emit("\x41\xff\x24\xc2", 4);		/* jmp [r10 + 8 * rax] */
+      native->code[skip - 1] = native->used - skip;
+    } else if (ops[at] == 1 || (ops[at] >= 9 && ops[at] <= 12)) {
+      native->Emit("\x4c\x39\xc6", 3);			/* cmp rsi, r8 */
+      native->EmitJump("\x0f\x83", 2, at);		/* jae exit */
+    }
+    native->Emit("\x49\xff\xc9", 3);			/* dec r9 */
+
+    switch (ops[at]) {
+    case 1:
+      native->Emit("\x8a\x0c\x32\x48\xff\xc6", 6);	/* mov cl, [rdx+rsi]; inc rsi */
+      break;
+    case 3:
+      native->Emit("\xc7\x47", 2);			/* mov endc, 1 */
+      native->EmitByte(offsetof(JitState, endc));
+      native->EmitWord(1);
+      break;
+    case 4:
+      native->Emit("\x0f\xb6\xf1", 3);			/* movzx esi, cl */
+      break;
+    case 5:
+      native->Emit("\x89\xf1", 2);			/* mov ecx, esi */
+      break;
+    case 6:
+      native->Emit("\x48\xc1\xfe\x08", 4);		/* sar rsi, 8 */
+      break;
+    case 7:
+      native->Emit("\x48\xc1\xe6\x08", 4);		/* shl rsi, 8 */
+      break;
+    case 8:
+      native->Emit("\x0f\xb6\xc1\x48\x01\xc6", 6);	/* movzx eax, cl; add rsi, rax */
+      break;
+    case 9:
+      native->Emit("\x02\x0c\x32", 3);			/* add cl, [rdx+rsi] */
+      break;
+    case 10:
+      native->Emit("\x22\x0c\x32", 3);			/* and cl, [rdx+rsi] */
+      break;
+    case 11:
+      native->Emit("\x0a\x0c\x32", 3);			/* or cl, [rdx+rsi] */
+      break;
+    case 12:
+      native->Emit("\x32\x0c\x32", 3);			/* xor cl, [rdx+rsi] */
+      break;
+    case 13:
+      native->Emit("\xf6\xd1", 2);			/* not cl */
+      break;
+    case 14:
+      native->Emit("\xd0\xe1", 2);			/* shl cl, 1 */
+      break;
+    case 15:
+      native->Emit("\xd0\xe9", 2);			/* shr cl, 1 */
+      break;
+    }
+  }
+  native->EmitJump("\xe9", 1, count);	/* the interpreter wraps around */
+
+  /* One exit per opcode, naming where to resume, into a shared tail */
+  exits = (unsigned *) malloc((count + 1) * sizeof(unsigned));
+  if (!exits) {
+    delete native;
+    return NULL;
+  }
+  for (at = 0; at <= count; at++) {
+    exits[at] = native->used;
+    native->EmitByte(0xb8);				/* mov eax, at */
+    native->EmitWord(at);
+    native->EmitByte(0xe9);				/* jmp tail */
+    native->EmitWord(10 * (count - at));
+  }
+  native->Emit("\x88\x4f", 2);				/* mov accu, cl */
+  native->EmitByte(offsetof(JitState, accu));
+  native->Emit("\x48\x89\x77", 3);			/* mov datl, rsi */
+  native->EmitByte(offsetof(JitState, datl));
+  native->Emit("\x4c\x89\x4f", 3);			/* mov budget, r9 */
+  native->EmitByte(offsetof(JitState, budget));
+  native->EmitByte(0xc3);				/* ret */
+  aiassert(native->used <= native->size, "genome code fits its buffer");
+
+  for (unsigned jump = 0; jump < native->jumpcount; jump++) {
+    unsigned field = native->jumps[2 * jump];
+    int rel = exits[native->jumps[2 * jump + 1]] - (field + 4);
+    memcpy(native->code + field, &rel, 4);
+  }
+  free(exits);
+
+  if (mprotect(native->code, native->size, PROT_READ | PROT_EXEC)) {
+    verbize(-3, "debug", "Genome code can't be made executable\n");
+    delete native;
+    return NULL;
+  }
+
+  __sync_fetch_and_add(&compiled, 1);
+  verbize(-5, "debug", "Compiled %d opcodes into %d bytes\n", count,
+	  native->used);
+
+  return native;
+#else
+  return NULL;
+#endif
+}
+
+unsigned GenomeCode::Run(unsigned at, JitState *state) {
+  return ((NativeCode) (code + count * sizeof(void *)))
+    (state, ((void **) code)[at]);
+}
+
+void GenomeCode::Emit(const char *bytes, unsigned len) {
+  memcpy(code + used, bytes, len);
+  used += len;
+}
+
+void GenomeCode::EmitByte(unsigned char byte) {
+  code[used++] = byte;
+}
+
+void GenomeCode::EmitWord(unsigned word) {
+  memcpy(code + used, &word, 4);
+  used += 4;
+}
+
+/* A jump to at's exit, whose offset is only known once they're laid out */
+void GenomeCode::EmitJump(const char *opcode, unsigned len, unsigned at) {
+  Emit(opcode, len);
+  jumps[2 * jumpcount] = used;
+  jumps[2 * jumpcount + 1] = at;
+  jumpcount++;
+  EmitWord(0);
+}
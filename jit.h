@@ -0,0 +1,50 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+
+#define JIT_THRESHOLD 1000  /* dnexec runs before a genome is compiled */
+#define JIT_OP_BYTES 80     /* room for the longest opcode and its exit */
+
+/* The part of dnexec's state that native code reads and changes */
+struct JitState {
+  long datl;
+  long budget;  /* instructions it may still run */
+  int endc;
+  unsigned char accu;
+};
+
+/* A genome's decoded opcodes as x86-64 code, enterable at any opcode,
+   with its taken tests jumping through a table so loops stay native.
+   It hands back to the interpreter at a write, a data access outside
+   the dna, a jump off the genome, the end of the genome, or when the
+   budget runs out, so dnexec's results are unchanged. */
+class GenomeCode {
+public:
+  /* NULL where native code can't be made; dna must stay put */
+  static GenomeCode *Compile(const unsigned char *ops, unsigned count,
+			     const unsigned char *dna, unsigned dnalen); // +
+  ~GenomeCode();
+
+  /* Returns the opcode position at which to carry on interpreting */
+  unsigned Run(unsigned at, JitState *state);
+
+  static unsigned long compiled;
+
+private:
+  GenomeCode();
+
+  void Emit(const char *bytes, unsigned len);
+  void EmitByte(unsigned char byte);
+  void EmitWord(unsigned word);
+  void EmitJump(const char *opcode, unsigned len, unsigned at);
+
+  unsigned char *code;  /* the table of opcode addresses, then their code */
+  size_t size;          /* mapped, and executable once made */
+  size_t used;
+  unsigned count;
+  unsigned *jumps;      /* rel32 fields, each a pair with its opcode */
+  unsigned jumpcount;
+};
+
+#endif
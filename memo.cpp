@@ -0,0 +1,92 @@
+#include "base.h"
+#include "memo.h"
+
+int PredictionCache::enabled = TRUE;
+MemoRun PredictionCache::slots[MEMO_SHARDS][MEMO_SLOTS];
+pthread_mutex_t PredictionCache::locks[MEMO_SHARDS] = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+unsigned long PredictionCache::hits[MEMO_SHARDS];
+unsigned long PredictionCache::misses[MEMO_SHARDS];
+
+int PredictionCache::Lookup(MemoRun &run) {
+  unsigned long key = Key(run);
+  unsigned shard = key % MEMO_SHARDS;
+  MemoRun *slot = &slots[shard][(key / MEMO_SHARDS) % MEMO_SLOTS];
+  int found;
+
+  if (aithreaded)
+    pthread_mutex_lock(&locks[shard]);
+  found = slot->dnalen && slot->dnahash == run.dnahash &&
+    slot->dnalen == run.dnalen && slot->dnal == run.dnal &&
+    slot->datl == run.datl && slot->side == run.side &&
+    slot->input == run.input;
+  if (found) {
+    run.outdnal = slot->outdnal;
+    run.outdatl = slot->outdatl;
+    run.outside = slot->outside;
+    run.accu = slot->accu;
+    run.endc = slot->endc;
+    hits[shard]++;
+  } else
+    misses[shard]++;
+  if (aithreaded)
+    pthread_mutex_unlock(&locks[shard]);
+
+  return found;
+}
+
+void PredictionCache::Store(const MemoRun &run) {
+  unsigned long key = Key(run);
+  unsigned shard = key % MEMO_SHARDS;
+
+  if (aithreaded)
+    pthread_mutex_lock(&locks[shard]);
+  slots[shard][(key / MEMO_SHARDS) % MEMO_SLOTS] = run;
+  if (aithreaded)
+    pthread_mutex_unlock(&locks[shard]);
+}
+
+/* 64-bit FNV-1a; dna only equal by hash is taken as equal */
+unsigned long PredictionCache::HashDna(const unsigned char *dna,
+				       unsigned len) {
+  unsigned long hash = 14695981039346656037UL;
+
+  for (unsigned at = 0; at < len; at++)
+    hash = (hash ^ dna[at]) * 1099511628211UL;
+  return hash;
+}
+
+unsigned long PredictionCache::GetHits() {
+  unsigned long total = 0;
+
+  for (unsigned shard = 0; shard < MEMO_SHARDS; shard++)
+    total += hits[shard];
+  return total;
+}
+
+unsigned long PredictionCache::GetMisses() {
+  unsigned long total = 0;
+
+  for (unsigned shard = 0; shard < MEMO_SHARDS; shard++)
+    total += misses[shard];
+  return total;
+}
+
+/* Mixes everything a run starts from, so neighbours spread out */
+unsigned long PredictionCache::Key(const MemoRun &run) {
+  unsigned long key = run.dnahash ^ (run.dnal * 0x9e3779b97f4a7c15UL) ^
+    (run.datl * 0xc2b2ae3d27d4eb4fUL) ^
+    ((unsigned long) run.side << 8 | run.input);
+
+  key ^= key >> 31;
+  key *= 0xbf58476d1ce4e5b9UL;
+  key ^= key >> 27;
+  return key;
+}
@@ -0,0 +1,48 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <pthread.h>
+
+#define MEMO_SHARDS 16     /* separately locked parts of the cache */
+#define MEMO_SLOTS 4096    /* remembered runs per shard */
+
+/* Where a genome's run starts, and where it ends up */
+struct MemoRun {
+  unsigned long dnahash;
+  unsigned dnalen;
+  long dnal, datl;
+  char side;
+  unsigned char input;
+
+  long outdnal, outdatl;
+  char outside;
+  unsigned char accu;
+  int endc;
+};
+
+/* Bounded memo of dnexec runs on genomes that don't write to themselves,
+   keyed on their dna's hash and registers.  Each slot holds the latest
+   run to land there. */
+class PredictionCache {
+public:
+  /* Fills in the out fields if the run is known */
+  static int Lookup(MemoRun &run);
+  static void Store(const MemoRun &run);
+
+  static unsigned long HashDna(const unsigned char *dna, unsigned len);
+
+  static unsigned long GetHits();
+  static unsigned long GetMisses();
+
+  static int enabled;
+
+private:
+  static unsigned long Key(const MemoRun &run);
+
+  static MemoRun slots[MEMO_SHARDS][MEMO_SLOTS];
+  static pthread_mutex_t locks[MEMO_SHARDS];
+  static unsigned long hits[MEMO_SHARDS];
+  static unsigned long misses[MEMO_SHARDS];
+};
+
+#endif
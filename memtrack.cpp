@@ -1,27 +1,38 @@
+#include <stdlib.h>
 #include "base.h"
 #include "memtrack.h"
 #include <exception>
 
-TrackLink *TrackLink::table[TABLE_BINS];
+TrackSlot *TrackLink::table = NULL;
+unsigned long TrackLink::tablesize = 0;
+unsigned long TrackLink::tablecount = 0;
+TrackSlot *TrackLink::oldtable = NULL;
+unsigned long TrackLink::oldsize = 0;
+unsigned long TrackLink::oldcount = 0;
+unsigned long TrackLink::migrated = 0;
 TrackLink *TrackLink::root = NULL;
+pthread_mutex_t TrackLink::lock;
 
 void TrackLink::MemInitialize() {
-  for (int i = 0; i < TABLE_BINS; i++)
-    table[i] = NULL;
+  pthread_mutexattr_t attr;
+
   root = new TrackLink(NULL);
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&lock, &attr);
+  pthread_mutexattr_destroy(&attr);
 }
 
 void TrackLink::MemDestroy() {
-  TrackLink *curr, *prev;
+  TrackLink *curr;
 
-  for (unsigned bin = 0; bin < TABLE_BINS; bin++) {
-    curr = table[bin];
-    while (curr) {
-      prev = curr;
-      curr = curr->next;
-      delete prev;
-    }
-  }
+  for (unsigned long at = 0; (curr = Walk(at)); at++)
+    delete curr;
+  free(table);
+  free(oldtable);
+  table = oldtable = NULL;
+  tablesize = tablecount = oldsize = oldcount = migrated = 0;
   delete root;
 }
 
@@ -29,50 +40,70 @@ TrackLink *TrackLink::MemRegister(void *ptr, unsigned long flags) {
   if (!ptr)
     return NULL;
 
+  Lock();
   try {
-    unsigned bin = HashPointer(ptr);
     TrackLink *newlink = new TrackLink(ptr);
     newlink->flag = flags;
 
     //printf("Registering %ld\n", ptr);
 
-    // install into table
-    newlink->next = table[bin];
-    if (table[bin])
-      table[bin]->prev = newlink;
-    table[bin] = newlink;
+    // install into table, kept at most three quarters full
+    if (4 * (tablecount + oldcount + 1) > 3 * tablesize)
+      Grow();
+    Migrate(TRACK_MIGRATE);
+    Install(ptr, newlink);
 
+    Unlock();
     return newlink;
   } catch (std::exception &e) {
     fprintf(stderr, "Error in memory tracking system: MemRegister: %s\n", e.what());
   }
+  Unlock();
+  return NULL;
 }
 
 void TrackLink::MemForget(TrackLink *link) {
   if (!link)
     return;
 
+  Lock();
   try {
-    unsigned bin = HashPointer(link->ptr);
+    TrackSlot *slot = FindSlot(link->ptr, link);
 
     //printf("Forgetting %ld\n", link->ptr);
 
-    if (link->prev)
-      link->prev->next = link->next;
-    else
-      table[bin] = link->next;
-    if (link->next)
-      link->next->prev = link->prev;
+    if (!slot)
+      fprintf(stderr, "Error in memory tracking system: MemForget: "
+	      "Link not found\n");
+    else if (slot >= oldtable && slot < oldtable + oldsize) {
+      slot->link = NULL;  // keeps its pointer; see TrackSlot
+      oldcount--;
+    } else {
+      // shift the run after it back a slot, up to one already home
+      unsigned long mask = tablesize - 1;
+      unsigned long at = slot - table, next;
+
+      for (next = (at + 1) & mask;
+	   table[next].ptr && (HashPointer(table[next].ptr) & mask) != next;
+	   at = next, next = (at + 1) & mask)
+	table[at] = table[next];
+      table[at].ptr = NULL;
+      table[at].link = NULL;
+      tablecount--;
+    }
+    Migrate(TRACK_MIGRATE);
     delete link;
   } catch (std::exception &e) {
     fprintf(stderr, "Error in memory tracking system: MemForget: %s\n", e.what());
   }
+  Unlock();
 }
 
 void TrackLink::MemStore(TrackLink *container, void *contained, char flag) {
   if (!container || !contained)
     return;
 
+  Lock();
   try {
     PointerLink *newlink = new PointerLink(contained, flag);
 
@@ -88,12 +119,14 @@ void TrackLink::MemStore(TrackLink *container, void *contained, char flag) {
   } catch (std::exception &e) {
     fprintf(stderr, "Error in memory tracking system: MemStore: %s\n", e.what());
   }
+  Unlock();
 }  
 
 void TrackLink::MemRemove(TrackLink *container, void *contained) {
   if (!container || !contained)
     return;
 
+  Lock();
   try {
     // Find it
     PointerLink *last = NULL, *curr = container->list;
@@ -118,32 +151,60 @@ void TrackLink::MemRemove(TrackLink *container, void *contained) {
   } catch (char *expn) {
     fprintf(stderr, "Error in memory tracking system: MemForget: %s\n", expn);
   }
+  Unlock();
+}
+
+/* For arrays of stored pointers about to move; one pass over the list */
+void TrackLink::MemRemoveRange(TrackLink *container, void *start,
+			       size_t len) {
+  if (!container || !start)
+    return;
+
+  Lock();
+  PointerLink *last = NULL, *curr = container->list;
+  while (curr) {
+    if ((char *) curr->ptr >= (char *) start &&
+	(char *) curr->ptr < (char *) start + len) {
+      PointerLink *gone = curr;
+      curr = curr->next;
+      if (last == NULL)
+	container->list = curr;
+      else
+	last->next = curr;
+      delete gone;
+    } else {
+      last = curr;
+      curr = curr->next;
+    }
+  }
+  Unlock();
 }
 
 void *TrackLink::MemMarkCheck() {
+  Lock();
   try {
+    TrackLink *curr;
+
     // Reset all markings
-    for (unsigned bin = 0; bin < TABLE_BINS; bin++) {
-      for (TrackLink *curr = table[bin]; curr; curr = curr->next) {
-	//printf("Clearing %ld\n", curr->ptr);
-	curr->flag &= ~((unsigned long) MARKED_FLAG);
-      }
+    for (unsigned long at = 0; (curr = Walk(at)); at++) {
+      //printf("Clearing %ld\n", curr->ptr);
+      curr->flag &= ~((unsigned long) MARKED_FLAG);
     }
 
     root->flag &= ~((unsigned long) MARKED_FLAG);
     MemMarkReachableFrom(root);
 
     // Find any memory that isn't reachable
-    for (unsigned bin = 0; bin < TABLE_BINS; bin++) {
-      for (TrackLink *curr = table[bin]; curr; curr = curr->next)
-	if (!(curr->flag & MARKED_FLAG))
-	  return curr->ptr;
-    }
-
-    return NULL;
+    for (unsigned long at = 0; (curr = Walk(at)); at++)
+      if (!(curr->flag & MARKED_FLAG)) {
+	Unlock();
+	return curr->ptr;
+      }
   } catch (std::exception &e) {
     fprintf(stderr, "Error in memory tracking system: MemMarkCheck: %s\n", e.what());
   }
+  Unlock();
+  return NULL;
 }
 
 void TrackLink::WriteAllObjects(FILE *fp, void *adnl, unsigned size) {
@@ -155,50 +216,50 @@ void TrackLink::WriteAllObjects(FILE *fp, void *adnl, unsigned size) {
 
   PointerLink plroot(NULL, FALSE);
 
+  Lock();
+
   //printf("Start WAO\n");
 
   // Output only those which can already be reconstructed from previous
-  for (unsigned bin = 0; bin < TABLE_BINS; bin++) {
-    for (curr = table[bin]; curr; curr = curr->next) {
-      // Check if this can be reconstructed
-      addedtotodo = FALSE;
-      for (PointerLink *link = curr->list; link; link = link->next) {
-	if (link->flag & CONST_FLAG) {
-	  alreadydone = FALSE;
-	  for (PointerLink *done = dones; done; done = done->next) {
-	    if (((TrackLink *) done->ptr)->ptr == link->ptr) {  // this one has been done
-	      alreadydone = TRUE;
-	      break;
-	    }
-	  }
-	  if (!alreadydone) {  // nope: add to todo list
-	    PointerLink *newlink = new PointerLink(curr, FALSE);
-	    newlink->next = todos;
-	    todos = newlink;
-	    addedtotodo = TRUE;
+  for (unsigned long at = 0; (curr = Walk(at)); at++) {
+    // Check if this can be reconstructed
+    addedtotodo = FALSE;
+    for (PointerLink *link = curr->list; link; link = link->next) {
+      if (link->flag & CONST_FLAG) {
+	alreadydone = FALSE;
+	for (PointerLink *done = dones; done; done = done->next) {
+	  if (((TrackLink *) done->ptr)->ptr == link->ptr) {  // this one has been done
+	    alreadydone = TRUE;
 	    break;
 	  }
 	}
-      }
-      if (!addedtotodo) {
-	fwrite(&(curr->ptr), sizeof(void *), 1, fp);
-	if (curr->flag & AIOBJ_FLAG) {
-	  fwrite(&(((AIObject *) curr->ptr)->type), sizeof(classtype), 1, fp);
-	  ((AIObject *) curr->ptr)->WriteObject(fp);
-	} else {
-	  classtype NoClassType = CInvalidClass;
-	  unsigned long size = (curr->flag) >> TL_FLAG_BITS;
-	  fwrite(&NoClassType, sizeof(classtype), 1, fp);
-	  curr->flag &= ~((unsigned long) MARKED_FLAG);
-	  fwrite(&size, sizeof(unsigned long), 1, fp);
-	  fwrite(curr->ptr, sizeof(char), size, fp);
+	if (!alreadydone) {  // nope: add to todo list
+	  PointerLink *newlink = new PointerLink(curr, FALSE);
+	  newlink->next = todos;
+	  todos = newlink;
+	  addedtotodo = TRUE;
+	  break;
 	}
-
-	PointerLink *newlink = new PointerLink(curr, FALSE);
-	newlink->next = dones;
-	dones = newlink;
       }
     }
+    if (!addedtotodo) {
+      fwrite(&(curr->ptr), sizeof(void *), 1, fp);
+      if (curr->flag & AIOBJ_FLAG) {
+	fwrite(&(((AIObject *) curr->ptr)->type), sizeof(classtype), 1, fp);
+	((AIObject *) curr->ptr)->WriteObject(fp);
+      } else {
+	classtype NoClassType = CInvalidClass;
+	unsigned long size = (curr->flag) >> TL_FLAG_BITS;
+	fwrite(&NoClassType, sizeof(classtype), 1, fp);
+	curr->flag &= ~((unsigned long) MARKED_FLAG);
+	fwrite(&size, sizeof(unsigned long), 1, fp);
+	fwrite(curr->ptr, sizeof(char), size, fp);
+      }
+
+      PointerLink *newlink = new PointerLink(curr, FALSE);
+      newlink->next = dones;
+      dones = newlink;
+    }
   }
 
   //printf("Middle WAO\n");
@@ -254,6 +315,7 @@ void TrackLink::WriteAllObjects(FILE *fp, void *adnl, unsigned size) {
 
     todos = plroot.next;
   }
+  fwrite(&ptrtonull, sizeof(void *), 1, fp);  // end of the objects
 
   //printf("Middle WAO\n");
 
@@ -279,15 +341,18 @@ void TrackLink::WriteAllObjects(FILE *fp, void *adnl, unsigned size) {
 
   // Also write out requested additional pointers
   fwrite(adnl, size, 1, fp);
+
+  Unlock();
 }
 
 void TrackLink::FixPointers(PointerMapLink *root) {
-  for (unsigned bin = 0; bin < TABLE_BINS; bin++)
-    for (TrackLink *curr = table[bin]; curr; curr = curr->next)
-      for (PointerLink *link = curr->list; link; link->next)
-	if (!(link->flag & CONST_FLAG))
-	  *((void **) link->ptr) =
-	    root->FindNewPointer(*((void **) link->ptr));
+  TrackLink *curr;
+
+  for (unsigned long at = 0; (curr = Walk(at)); at++)
+    for (PointerLink *link = curr->list; link; link = link->next)
+      if (!(link->flag & CONST_FLAG))
+	*((void **) link->ptr) =
+	  root->FindNewPointer(*((void **) link->ptr));
 }
 
 void TrackLink::MemMarkReachableFrom(TrackLink *track) {
@@ -306,26 +371,143 @@ void TrackLink::MemMarkReachableFrom(TrackLink *track) {
 }
 
 TrackLink *TrackLink::MemFindLink(void *ptr) {
+  TrackSlot *slot;
+  TrackLink *link;
+
   if (!ptr)
     return NULL;
 
-  try {
-    unsigned bin = HashPointer(ptr);
-    for (TrackLink *curr = table[bin]; curr; curr = curr->next)
-      if (curr->ptr == ptr)
-	return curr;
-    throw "Pointer not found";
-  } catch (std::exception &e) {
-    fprintf(stderr, "Error in memory tracking system: MemFindLink: %s\n", e.what());
-  } catch (char *expn) {
-    fprintf(stderr, "Error in memory tracking system: MemFindLink: %s\n", expn);
+  Lock();
+  slot = FindSlot(ptr, NULL);
+  link = slot ? slot->link : NULL;
+  Unlock();
+
+  if (!link)
+    fprintf(stderr, "Error in memory tracking system: MemFindLink: "
+	    "Pointer not found\n");
+  return link;
+}
+
+/* The slot holding ptr, and link if given, from either table */
+TrackSlot *TrackLink::FindSlot(void *ptr, TrackLink *link) {
+  TrackSlot *slots = table;
+  unsigned long size = tablesize;
+
+  for (int pass = 0; pass < 2 && slots; pass++) {
+    unsigned long mask = size - 1;
+    unsigned long at = HashPointer(ptr) & mask;
+
+    // a Robin Hood run never holds one nearer home than we'd be by now
+    for (unsigned long dist = 0; slots[at].ptr &&
+	   ((at - HashPointer(slots[at].ptr)) & mask) >= dist;
+	 at = (at + 1) & mask, dist++)
+      if (slots[at].ptr == ptr && slots[at].link &&
+	  (!link || slots[at].link == link))
+	return &slots[at];
+
+    slots = oldtable;
+    size = oldsize;
+  }
+
+  return NULL;
+}
+
+/* Into the current table; each taking the slot of any nearer its home */
+void TrackLink::Install(void *ptr, TrackLink *link) {
+  unsigned long mask = tablesize - 1;
+  unsigned long at = HashPointer(ptr) & mask, dist = 0, theirs;
+  TrackSlot moving;
+
+  moving.ptr = ptr;
+  moving.link = link;
+  for (;; at = (at + 1) & mask, dist++) {
+    if (!table[at].ptr) {
+      table[at] = moving;
+      break;
+    }
+    theirs = (at - HashPointer(table[at].ptr)) & mask;
+    if (theirs < dist) {
+      TrackSlot displaced = table[at];
+
+      table[at] = moving;
+      moving = displaced;
+      dist = theirs;
+    }
+  }
+  tablecount++;
+}
+
+/* Doubles the table, leaving the old one to be emptied by Migrate;
+   the first is made here too, so objects may register before
+   MemInitialize */
+void TrackLink::Grow() {
+  unsigned long size = tablesize ? 2 * tablesize : TRACK_MIN_SLOTS;
+  TrackSlot *slots;
+
+  if (oldtable)
+    Migrate(oldsize);
+
+  slots = (TrackSlot *) calloc(size, sizeof(TrackSlot));
+  if (!slots) {
+    fprintf(stderr, "Error in memory tracking system: Grow: "
+	    "No room for %ld slots\n", size);
+    exit(MEMORY_ERROR);
+  }
+
+  oldtable = table;
+  oldsize = tablesize;
+  oldcount = tablecount;
+  migrated = 0;
+  table = slots;
+  tablesize = size;
+  tablecount = 0;
+}
+
+/* Moves on up to steps old slots.  Grown at three quarters full, the
+   old table is empty before the new one gets there. */
+void TrackLink::Migrate(unsigned long steps) {
+  while (oldtable && oldcount && steps--) {
+    TrackSlot *slot = &oldtable[migrated++];
+
+    if (slot->link) {
+      Install(slot->ptr, slot->link);
+      slot->link = NULL;
+      oldcount--;
+    }
+  }
+
+  if (oldtable && !oldcount) {
+    free(oldtable);
+    oldtable = NULL;
+    oldsize = migrated = 0;
+  }
+}
+
+/* The first record at or after at, over both tables; NULL past the end */
+TrackLink *TrackLink::Walk(unsigned long &at) {
+  for (; at < tablesize + oldsize; at++) {
+    TrackSlot *slot = at < tablesize ? &table[at] : &oldtable[at - tablesize];
+
+    if (slot->link)
+      return slot->link;
   }
+
+  return NULL;
+}
+
+/* Tracking is shared by all coderack workers once they start */
+void TrackLink::Lock() {
+  if (aithreaded)
+    pthread_mutex_lock(&lock);
+}
+
+void TrackLink::Unlock() {
+  if (aithreaded)
+    pthread_mutex_unlock(&lock);
 }
 
 TrackLink::TrackLink(void *ptrarg) {
   ptr = ptrarg;
-  next = NULL;
-  prev = NULL;
   flag = 0;
   list = NULL;
 }
@@ -346,6 +528,9 @@ PointerLink::PointerLink(void *contained, char flagarg) {
   next = NULL;
 }
 
-unsigned HashPointer(void *ptr) {
-  return ((unsigned long) ptr / 3) % TABLE_BINS;
+/* Fibonacci hashing, folded so the low bits used as a slot see the high */
+unsigned long HashPointer(void *ptr) {
+  unsigned long hash = (unsigned long) ptr * 0x9E3779B97F4A7C15UL;
+
+  return hash ^ (hash >> 29);
 }
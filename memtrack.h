@@ -1,11 +1,15 @@
 #ifndef MEMTRACK_H
 #define MEMTRACK_H
 
+#include <pthread.h>
+#include "arena.h"
+
 class TrackLink;
 class PointerLink;
 class PointerMapLink;
 
-#define TABLE_BINS 1024
+#define TRACK_MIN_SLOTS 1024  /* slots in the pointer table at first */
+#define TRACK_MIGRATE 4       /* old slots moved on by each register/forget */
 
 // flags is the number of bytes allocated for a non-AI-object, shift right by 2
 // plus the other flags
@@ -13,6 +17,14 @@ class PointerMapLink;
 #define MARKED_FLAG 0x01
 #define AIOBJ_FLAG 0x02
 
+/* A table slot: the tracked pointer, kept inline to probe on, and its
+   record.  A slot of the table being migrated away from keeps its
+   pointer once its record has gone, so later probes still pass it. */
+struct TrackSlot {
+  void *ptr;
+  TrackLink *link;
+};
+
 class TrackLink {
 public:
 
@@ -25,6 +37,8 @@ public:
   // NULL container => install into ROOT
   static void MemStore(TrackLink *container, void *contained, char flag);
   static void MemRemove(TrackLink *container, void *contained);
+  // forget every stored pointer lying within [start, start + len)
+  static void MemRemoveRange(TrackLink *container, void *start, size_t len);
 
   static void *MemMarkCheck();
 
@@ -35,17 +49,38 @@ public:
 
   static TrackLink *root;
 
+  static void *operator new(size_t size) {
+    return trackarena.Alloc(size);
+  }
+
+  static void operator delete(void *ptr, size_t size) {
+    trackarena.Free(ptr, size);
+  }
+
 private:
   TrackLink(void *ptr);
   ~TrackLink();
 
   static void MemMarkReachableFrom(TrackLink *track);
 
-  static TrackLink *table[TABLE_BINS];
+  static void Lock();
+  static void Unlock();
+
+  static TrackSlot *FindSlot(void *ptr, TrackLink *link);
+  static void Install(void *ptr, TrackLink *link);
+  static void Grow();
+  static void Migrate(unsigned long steps);
+  static TrackLink *Walk(unsigned long &at);
+
+  // Robin Hood open addressing; on growth, the old table is emptied into
+  // the new a few slots at a time rather than all at once
+  static TrackSlot *table;
+  static unsigned long tablesize, tablecount;
+  static TrackSlot *oldtable;
+  static unsigned long oldsize, oldcount, migrated;
+  static pthread_mutex_t lock;  // recursive; only taken once threaded
 
   void *ptr;
-  TrackLink *next;
-  TrackLink *prev;
   unsigned long flag;
   PointerLink *list;
 };
@@ -56,6 +91,14 @@ class PointerLink {
 public:
   PointerLink(void *contained, char flag);
 
+  static void *operator new(size_t size) {
+    return trackarena.Alloc(size);
+  }
+
+  static void operator delete(void *ptr, size_t size) {
+    trackarena.Free(ptr, size);
+  }
+
   char flag;
   void *ptr;
   struct PointerLink *next;
@@ -84,6 +127,6 @@ public:
   PointerMapLink *next;
 };
 
-unsigned HashPointer(void *ptr);
+unsigned long HashPointer(void *ptr);
 
 #endif
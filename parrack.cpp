@@ -0,0 +1,370 @@
+#include <unistd.h>
+#include <sched.h>
+#include <exception>
+#include "parrack.h"
+#include "reclaim.h"
+
+struct WorkerArg {
+  ParallelCoderack *rack;
+  unsigned worker;
+};
+
+/* Which rack and worker the calling thread is running for, if any */
+static __thread ParallelCoderack *workerrack = NULL;
+static __thread unsigned workerid = 0;
+
+/* prefer writers, or housekeeping codelets would never get a turn */
+pthread_rwlock_t ParallelCoderack::exclusive =
+  PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+ParallelCoderack::ParallelCoderack(unsigned long maxsz, unsigned nwork) :
+  Coderack(maxsz, CParallelCoderack) {
+  nworkers = nwork;
+  nextrack = 0;
+  running = FALSE;
+  threads = NULL;
+
+  racks = (Coderack **) aialloc(sizeof(Coderack *) * nworkers,
+				"ParallelCoderack racks", 1, -1);
+  inflight = (Codelet **) aialloc(sizeof(Codelet *) * nworkers,
+				  "ParallelCoderack in-flight codelets", 1, -1);
+  /* always flat: workers empty and refill their racks constantly */
+  for (unsigned w = 0; w < nworkers; w++) {
+    racks[w] = new FlatCoderack(maxsz / nworkers + 1);
+    inflight[w] = NULL;
+    TrackLink::MemStore(trackid, &racks[w], FALSE);
+    TrackLink::MemStore(trackid, &inflight[w], FALSE);
+  }
+
+  InitLocks();
+
+  TrackLink::MemStore(trackid, &racks, FALSE);
+  TrackLink::MemStore(trackid, &inflight, FALSE);
+}
+
+ParallelCoderack::ParallelCoderack(FILE *fp) :
+  Coderack(fp) {
+  fread(&nworkers, sizeof(unsigned), 1, fp);
+
+  racks = (Coderack **) aialloc(sizeof(Coderack *) * nworkers,
+				"ParallelCoderack racks", 1, -1);
+  inflight = (Codelet **) aialloc(sizeof(Codelet *) * nworkers,
+				  "ParallelCoderack in-flight codelets", 1, -1);
+  fread(racks, sizeof(Coderack *), nworkers, fp);
+  for (unsigned w = 0; w < nworkers; w++) {
+    inflight[w] = NULL;
+    TrackLink::MemStore(trackid, &racks[w], FALSE);
+    TrackLink::MemStore(trackid, &inflight[w], FALSE);
+  }
+
+  nextrack = 0;
+  running = FALSE;
+  threads = NULL;
+  InitLocks();
+
+  TrackLink::MemStore(trackid, &racks, FALSE);
+  TrackLink::MemStore(trackid, &inflight, FALSE);
+}
+
+ParallelCoderack::~ParallelCoderack() {
+  Stop();
+
+  for (unsigned w = 0; w < nworkers; w++) {
+    delete racks[w];
+    pthread_mutex_destroy(&racklocks[w]);
+  }
+  aifree(racks);
+  aifree(inflight);
+  delete[] racklocks;
+  delete[] totals;
+}
+
+void ParallelCoderack::AddCodelet(Codelet *cdlet) {
+  unsigned w = CurrentRack();
+
+  pthread_mutex_lock(&racklocks[w]);
+  racks[w]->AddCodelet(cdlet);
+  Publish(w);
+  pthread_mutex_unlock(&racklocks[w]);
+}
+
+void ParallelCoderack::RemoveCodelet() {
+  unsigned w = CurrentRack();
+
+  pthread_mutex_lock(&racklocks[w]);
+  racks[w]->RemoveCodelet();
+  Publish(w);
+  pthread_mutex_unlock(&racklocks[w]);
+}
+
+/* The workers do the executing; the caller just gives them a tick */
+void ParallelCoderack::ExecuteCodelet() {
+  if (!running)
+    Start();
+  usleep(PARALLEL_TICK);
+}
+
+/* The workers draw at their own pace, so a count means nothing here */
+void ParallelCoderack::ExecuteCodelets(unsigned) {
+  ExecuteCodelet();
+}
+
+Codelet *ParallelCoderack::TakeCodelet() {
+  unsigned w = CurrentRack();
+  Codelet *cdlet;
+
+  pthread_mutex_lock(&racklocks[w]);
+  cdlet = racks[w]->TakeCodelet();
+  Publish(w);
+  pthread_mutex_unlock(&racklocks[w]);
+
+  return cdlet;
+}
+
+/* From the published totals, so without taking any rack's lock */
+urgesumtype ParallelCoderack::getTotalUrgency() {
+  urgesumtype total = 0.;
+
+  for (unsigned w = 0; w < nworkers; w++)
+    total += Published(w);
+  return total;
+}
+
+/* Codelets a worker has already taken run out their turn */
+unsigned long ParallelCoderack::CancelCodelets() {
+  unsigned long cancelled = 0;
+
+  for (unsigned w = 0; w < nworkers; w++) {
+    pthread_mutex_lock(&racklocks[w]);
+    cancelled += racks[w]->CancelCodelets();
+    Publish(w);
+    pthread_mutex_unlock(&racklocks[w]);
+  }
+  return cancelled;
+}
+
+unsigned long ParallelCoderack::getSize() {
+  unsigned long total = 0;
+
+  for (unsigned w = 0; w < nworkers; w++)
+    total += racks[w]->getSize();
+  return total;
+}
+
+void ParallelCoderack::recalcTotalUrgency() {
+  for (unsigned w = 0; w < nworkers; w++) {
+    pthread_mutex_lock(&racklocks[w]);
+    racks[w]->recalcTotalUrgency();
+    Publish(w);
+    pthread_mutex_unlock(&racklocks[w]);
+  }
+}
+
+void ParallelCoderack::print() {
+  printf("Parallel rack %p: %d workers, %ld of %ld.\n", this, nworkers,
+	 getSize(), maxsize);
+  for (unsigned w = 0; w < nworkers; w++)
+    racks[w]->print();
+}
+
+void ParallelCoderack::Quiesce() {
+  if (running)
+    pthread_rwlock_wrlock(&exclusive);
+}
+
+void ParallelCoderack::Resume() {
+  if (running)
+    pthread_rwlock_unlock(&exclusive);
+}
+
+void ParallelCoderack::Start() {
+  if (running)
+    return;
+
+  /* a restored rack's pointers are only fixed by now */
+  for (unsigned w = 0; w < nworkers; w++) {
+    pthread_mutex_lock(&racklocks[w]);
+    Publish(w);
+    pthread_mutex_unlock(&racklocks[w]);
+  }
+
+  aithreaded = TRUE;
+  running = TRUE;
+
+  threads = new pthread_t[nworkers];
+  for (unsigned w = 0; w < nworkers; w++) {
+    WorkerArg *arg = new WorkerArg;
+    arg->rack = this;
+    arg->worker = w;
+    if (pthread_create(&threads[w], NULL, Worker, arg)) {
+      verbize(3, "error", "Failed to start coderack worker %d\n", w);
+      exit(UNSPEC_ERROR);
+    }
+  }
+
+  verbize(1, "", "Started %d coderack workers\n", nworkers);
+}
+
+void ParallelCoderack::Stop() {
+  if (!running)
+    return;
+
+  running = FALSE;
+  for (unsigned w = 0; w < nworkers; w++)
+    pthread_join(threads[w], NULL);
+  delete[] threads;
+  threads = NULL;
+}
+
+int ParallelCoderack::AssertValid() {
+  AIObject *obj;
+
+  for (unsigned w = 0; w < nworkers; w++) {
+    obj = dynamic_cast<AIObject*>(racks[w]);
+    aiassert(obj && (obj->type == CCoderack || obj->type == CFlatCoderack),
+	     "checking validity of worker rack");
+    pthread_mutex_lock(&racklocks[w]);
+    aiassert(racks[w]->AssertValid(), "valid worker rack");
+    pthread_mutex_unlock(&racklocks[w]);
+  }
+
+  return (type == CParallelCoderack);
+}
+
+int ParallelCoderack::WriteObject(FILE *fp) {
+  size_t result = Coderack::WriteObject(fp);
+  result = fwrite(&nworkers, sizeof(unsigned), 1, fp) + result;
+  return fwrite(racks, sizeof(Coderack *), nworkers, fp) + result;
+}
+
+void *ParallelCoderack::Worker(void *arg) {
+  ParallelCoderack *rack = ((WorkerArg *) arg)->rack;
+  unsigned w = ((WorkerArg *) arg)->worker;
+  delete (WorkerArg *) arg;
+
+  workerrack = rack;
+  workerid = w;
+
+  while (rack->running) {
+    /* even taking one must wait out a privileged codelet */
+    pthread_rwlock_rdlock(&rack->exclusive);
+    Codelet *torun = rack->NextCodelet(w);
+
+    if (!torun) {
+      pthread_rwlock_unlock(&rack->exclusive);
+      sched_yield();
+      continue;
+    }
+
+    /* it stays reachable through inflight while we change locks */
+    if (torun->getFlags() & PRIV_FLAG) {
+      pthread_rwlock_unlock(&rack->exclusive);
+      pthread_rwlock_wrlock(&rack->exclusive);
+    }
+
+    verbize(-3, "", "Worker %d executing codelet %p: %s\n", w, torun,
+	    torun->Class());
+
+    /* elements it reads stay put until it leaves */
+    EpochReclaimer::Enter();
+    try {
+      torun->Execute();
+    } catch (std::exception &e) {
+      verbize(2, "error", "Exception: %s", e.what());
+    } catch (...) {
+      verbize(2, "error", "Unknown exception in worker %d\n", w);
+    }
+    EpochReclaimer::Leave();
+
+    /* still holding the lock, so no checker sees it half deleted */
+    if (torun->getFlags() & REARM_FLAG) {
+      torun->Disarm();
+      rack->AddCodelet(torun);
+    } else
+      delete torun;
+    rack->inflight[w] = NULL;
+
+    pthread_rwlock_unlock(&rack->exclusive);
+  }
+
+  return NULL;
+}
+
+Codelet *ParallelCoderack::NextCodelet(unsigned w) {
+  Codelet *torun;
+
+  if (Published(w) < STEAL_RATIO * getTotalUrgency() / nworkers)
+    Steal(w);
+
+  pthread_mutex_lock(&racklocks[w]);
+  torun = racks[w]->TakeCodelet();
+  inflight[w] = torun;
+  Publish(w);
+  pthread_mutex_unlock(&racklocks[w]);
+
+  return torun;
+}
+
+/* Move a batch, drawn by urgency, from the busiest rack into rack w */
+void ParallelCoderack::Steal(unsigned w) {
+  unsigned victim = w, n;
+  urgesumtype most = Published(w), total;
+
+  for (unsigned v = 0; v < nworkers; v++)
+    if ((total = Published(v)) > most) {
+      most = total;
+      victim = v;
+    }
+  if (victim == w)
+    return;
+
+  /* always lock the lower rack first */
+  pthread_mutex_lock(&racklocks[min(w, victim)]);
+  pthread_mutex_lock(&racklocks[w < victim ? victim : w]);
+
+  for (n = 0; n < STEAL_COUNT && racks[victim]->getSize() > 1; n++) {
+    Codelet *cdlet = racks[victim]->TakeCodelet();
+    if (!cdlet)
+      break;
+    racks[w]->AddCodelet(cdlet);
+  }
+  Publish(victim);
+  Publish(w);
+
+  pthread_mutex_unlock(&racklocks[w < victim ? victim : w]);
+  pthread_mutex_unlock(&racklocks[min(w, victim)]);
+
+  verbize(-4, "debug", "Worker %d stole %d codelets from %d\n", w, n, victim);
+}
+
+/* Workers add to their own rack; anyone else goes round-robin */
+unsigned ParallelCoderack::CurrentRack() {
+  if (workerrack == this)
+    return workerid;
+  return __sync_fetch_and_add(&nextrack, 1) % nworkers;
+}
+
+/* Leaves racks alone, which may still hold a saved run's pointers;
+   Start publishes their totals */
+void ParallelCoderack::InitLocks() {
+  racklocks = new pthread_mutex_t[nworkers];
+  totals = new urgesumtype[nworkers];
+  for (unsigned w = 0; w < nworkers; w++) {
+    pthread_mutex_init(&racklocks[w], NULL);
+    totals[w] = 0;
+  }
+}
+
+/* Rack w's urgency, for those not holding its lock; call with it held */
+void ParallelCoderack::Publish(unsigned w) {
+  urgesumtype total = racks[w]->getTotalUrgency();
+
+  __atomic_store(&totals[w], &total, __ATOMIC_RELAXED);
+}
+
+urgesumtype ParallelCoderack::Published(unsigned w) {
+  urgesumtype total;
+
+  __atomic_load(&totals[w], &total, __ATOMIC_RELAXED);
+  return total;
+}
@@ -0,0 +1,67 @@
+#ifndef PARRACK_H
+#define PARRACK_H
+
+#include <pthread.h>
+#include "coderack.h"
+
+#define STEAL_RATIO .5   /* steal when below this share of the average */
+#define STEAL_COUNT 16   /* most codelets moved by one steal */
+#define PARALLEL_TICK 1000  /* usec the main thread waits per ExecuteCodelet */
+
+/* Coderack sharded across worker threads, each drawing from its own rack.
+   Codelets added by a worker go to that worker's rack; a worker whose
+   rack falls well below the average urgency steals a batch, drawn by
+   urgency, from the busiest rack.  Ordinary codelets run side by side;
+   privileged (housekeeping) codelets run with all the others stopped,
+   as does anything between Quiesce() and Resume().  That exclusion
+   covers every ParallelCoderack, so it holds across a workspace tower;
+   quiesce just one of them at a time. */
+class ParallelCoderack : public Coderack {
+public:
+  ParallelCoderack(unsigned long maxsz, unsigned nworkers);
+  ParallelCoderack(FILE *fp);
+  ~ParallelCoderack();
+
+  virtual void RemoveCodelet();
+  virtual void AddCodelet(Codelet *codelet);  // -codelet
+  virtual void ExecuteCodelet();
+  virtual void ExecuteCodelets(unsigned count);
+  virtual Codelet *TakeCodelet();  // +
+  virtual unsigned long CancelCodelets();
+  virtual urgesumtype getTotalUrgency();
+  virtual unsigned long getSize();
+  virtual void recalcTotalUrgency();
+  virtual void print();
+
+  virtual void Quiesce();
+  virtual void Resume();
+
+  void Start();
+  void Stop();
+
+  virtual int AssertValid();
+
+  virtual int WriteObject(FILE *fp);
+
+private:
+  static void *Worker(void *arg);
+  Codelet *NextCodelet(unsigned w);
+  void Steal(unsigned w);
+  unsigned CurrentRack();
+  void InitLocks();
+  void Publish(unsigned w);
+  urgesumtype Published(unsigned w);
+
+  unsigned nworkers;
+  Coderack **racks;
+  Codelet **inflight;  /* taken by each worker but not yet deleted */
+  unsigned nextrack;   /* round-robin for adds from outside the workers */
+
+  volatile int running;
+  pthread_t *threads;
+  pthread_mutex_t *racklocks;
+  urgesumtype *totals;  /* each rack's urgency, as of its last change */
+  static pthread_rwlock_t exclusive;  /* shared by all racks */
+};
+
+#endif
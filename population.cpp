@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <string.h>
+#include "base.h"
+#include "population.h"
+#include "system.h"
+
+PopulationChunk *SystemPopulation::chunks[POP_CHUNKS];
+unsigned SystemPopulation::chunkcount = 0;
+unsigned *SystemPopulation::freeslots = NULL;
+unsigned SystemPopulation::freecount = 0;
+unsigned SystemPopulation::freeroom = 0;
+unsigned long SystemPopulation::count = 0;
+unsigned long SystemPopulation::culledcount = 0;
+unsigned long SystemPopulation::budget = 0;
+pthread_mutex_t SystemPopulation::lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A cleared slot for system; the store is derived, so kept out of memtrack */
+unsigned SystemPopulation::Join(EvolSystem *system) {
+  PopulationChunk *chunk;
+  unsigned slot;
+
+  if (aithreaded)
+    pthread_mutex_lock(&lock);
+  if (freecount)
+    slot = freeslots[--freecount];
+  else {
+    if (chunkcount == POP_CHUNKS) {
+      verbize(2, "error", "More than %d systems at once\n",
+	      POP_CHUNK * POP_CHUNKS);
+      exit(MEMORY_ERROR);
+    }
+    chunk = (PopulationChunk *) calloc(1, sizeof(PopulationChunk));
+    if (!chunk) {
+      verbize(2, "error", "No room for systems past %d\n",
+	      chunkcount * POP_CHUNK);
+      exit(MEMORY_ERROR);
+    }
+    freeslots = (unsigned *) realloc(freeslots, (freeroom += POP_CHUNK) *
+				     sizeof(unsigned));
+    if (!freeslots) {
+      verbize(2, "error", "No room to track free system slots\n");
+      exit(MEMORY_ERROR);
+    }
+    /* the new chunk's slots, handed out lowest first */
+    for (unsigned at = POP_CHUNK - 1; at > 0; at--)
+      freeslots[freecount++] = chunkcount * POP_CHUNK + at;
+    slot = chunkcount * POP_CHUNK;
+    chunks[chunkcount++] = chunk;
+  }
+  count++;
+  chunk = chunks[slot / POP_CHUNK];
+  chunk->system[slot % POP_CHUNK] = system;
+  if (aithreaded)
+    pthread_mutex_unlock(&lock);
+
+  return slot;
+}
+
+void SystemPopulation::Leave(unsigned slot) {
+  PopulationChunk *chunk = chunks[slot / POP_CHUNK];
+  unsigned at = slot % POP_CHUNK;
+
+  if (aithreaded)
+    pthread_mutex_lock(&lock);
+  chunk->score[at] = chunk->predictions[at] = 0;
+  chunk->totalinst[at] = chunk->age[at] = 0;
+  chunk->credfact[at] = 0.;
+  if (chunk->culled[at])
+    culledcount--;
+  chunk->culled[at] = FALSE;
+  chunk->system[at] = NULL;
+  freeslots[freecount++] = slot;
+  count--;
+  if (aithreaded)
+    pthread_mutex_unlock(&lock);
+}
+
+PopulationChunk *SystemPopulation::GetChunk(unsigned slot) {
+  return chunks[slot / POP_CHUNK];
+}
+
+unsigned SystemPopulation::GetChunkCount() {
+  return chunkcount;
+}
+
+float SystemPopulation::GetCredibility(PopulationChunk *chunk,
+				       unsigned at) {
+  unsigned long score = chunk->score[at];
+  unsigned long predictions = chunk->predictions[at];
+
+  if (predictions && score)
+    return chunk->credfact[at] * ((float) score) / ((float) predictions);
+  if (predictions)
+    return chunk->credfact[at] / predictions;
+  return chunk->credfact[at];
+}
+
+/* One scan keeps the want least credible in a max-heap, whose top is
+   the first to be bumped by anything less credible; those left are
+   culled.  Only basic systems are taken: a combo's leaves are culled
+   instead, and it sheds them at its next CheckLife.  Returns how many
+   were newly culled. */
+unsigned long SystemPopulation::Cull() {
+  unsigned long want, held = 0;
+  unsigned *heap;
+  float *creds;
+
+  if (aithreaded)
+    pthread_mutex_lock(&lock);
+  if (!budget || count - culledcount <= budget) {
+    if (aithreaded)
+      pthread_mutex_unlock(&lock);
+    return 0;
+  }
+  want = count - culledcount - budget + budget / POP_CULL_SLACK;
+  heap = (unsigned *) malloc(want * sizeof(unsigned));
+  creds = (float *) malloc(want * sizeof(float));
+  if (!heap || !creds) {
+    verbize(-1, "debug", "No room to choose %ld systems to cull\n", want);
+    free(heap);
+    free(creds);
+    if (aithreaded)
+      pthread_mutex_unlock(&lock);
+    return 0;
+  }
+
+  for (unsigned c = 0; c < chunkcount; c++) {
+    PopulationChunk *chunk = chunks[c];
+
+    for (unsigned at = 0; at < POP_CHUNK; at++) {
+      unsigned long node, child;
+      float cred;
+
+      if (!chunk->system[at] || chunk->culled[at] ||
+	  chunk->system[at]->type != CEvolSystemBasic)
+	continue;
+      cred = GetCredibility(chunk, at);
+      if (held == want) {
+	if (cred >= creds[0])
+	  continue;
+	node = 0;  /* replace the top, then sift it down */
+	for (; (child = 2 * node + 1) < held; node = child) {
+	  if (child + 1 < held && creds[child + 1] > creds[child])
+	    child++;
+	  if (creds[child] <= cred)
+	    break;
+	  heap[node] = heap[child];
+	  creds[node] = creds[child];
+	}
+      } else  /* add at the bottom, then sift it up */
+	for (node = held++; node && creds[(node - 1) / 2] < cred;
+	     node = (node - 1) / 2) {
+	  heap[node] = heap[(node - 1) / 2];
+	  creds[node] = creds[(node - 1) / 2];
+	}
+      heap[node] = c * POP_CHUNK + at;
+      creds[node] = cred;
+    }
+  }
+
+  for (unsigned long which = 0; which < held; which++)
+    chunks[heap[which] / POP_CHUNK]->culled[heap[which] % POP_CHUNK] = TRUE;
+  culledcount += held;
+  if (aithreaded)
+    pthread_mutex_unlock(&lock);
+
+  free(heap);
+  free(creds);
+  verbize(-3, "debug", "Culled %ld systems of %ld\n", held, count);
+  return held;
+}
+
+unsigned long SystemPopulation::GetCount() {
+  return count;
+}
+
+unsigned long SystemPopulation::GetCulledCount() {
+  return culledcount;
+}
+
+/* Free slots hold an age of 0, so a plain sum does */
+double SystemPopulation::GetAverageAge() {
+  unsigned long total = 0;
+
+  if (!count)
+    return 0.;  /* before the first system, or after a cull empties it */
+  for (unsigned chunk = 0; chunk < chunkcount; chunk++)
+    for (unsigned at = 0; at < POP_CHUNK; at++)
+      total += chunks[chunk]->age[at];
+
+  return (double) total / (double) count;
+}
@@ -0,0 +1,55 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include <pthread.h>
+
+#define POP_CHUNK 4096    /* slots per chunk of the store */
+#define POP_CHUNKS 4096   /* most chunks, so at most 16M systems at once */
+#define POP_CULL_SLACK 16 /* a cull goes budget / this under, so culls batch */
+
+class EvolSystem;
+
+/* A chunk's worth of each system's scalars, one array per field */
+struct PopulationChunk {
+  unsigned long score[POP_CHUNK];
+  unsigned long predictions[POP_CHUNK];
+  unsigned long totalinst[POP_CHUNK];
+  unsigned long age[POP_CHUNK];
+  float credfact[POP_CHUNK];
+  char culled[POP_CHUNK];  /* evicted, so dropped by whatever holds it */
+  EvolSystem *system[POP_CHUNK];  /* NULL for a free slot */
+};
+
+/* The counters of every live System, by slot, so passes over the whole
+   population are scans of contiguous arrays.  Chunks are never moved
+   or freed, so a system's cell stays put while others come and go. */
+class SystemPopulation {
+public:
+  static unsigned Join(EvolSystem *system);
+  static void Leave(unsigned slot);
+
+  static PopulationChunk *GetChunk(unsigned slot);
+  static unsigned GetChunkCount();  /* chunks made so far */
+
+  static float GetCredibility(PopulationChunk *chunk, unsigned at);
+
+  /* Over budget, marks the least credible basic systems as culled */
+  static unsigned long Cull();
+
+  static unsigned long GetCount();
+  static unsigned long GetCulledCount();
+  static double GetAverageAge();
+
+  static unsigned long budget;  /* most live systems, or 0 for no limit */
+
+private:
+  static PopulationChunk *chunks[POP_CHUNKS];
+  static unsigned chunkcount;
+  static unsigned *freeslots;  /* left by systems, reused first */
+  static unsigned freecount, freeroom;
+  static unsigned long count;
+  static unsigned long culledcount;  /* culled, but still held */
+  static pthread_mutex_t lock;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include "evolet.h"
 #include "checker.h"
 #include "textshow.h"
+#include "parrack.h"
 
 struct BasePointers ReadAllObjects(FILE *fp) {
   PointerMapLink *root = NULL;
@@ -20,7 +21,7 @@ struct BasePointers ReadAllObjects(FILE *fp) {
   printf("Test: %ld\n", fp);
 
   // Read in all objects
-  while (fread(&oldptr, sizeof(void *), 1, fp)) {
+  while (fread(&oldptr, sizeof(void *), 1, fp) && oldptr) {
     fread(&type, sizeof(classtype), 1, fp);
 
     verbize(-3, "", "Reading object %ld, of type %d\n", oldptr, type);
@@ -30,6 +31,7 @@ struct BasePointers ReadAllObjects(FILE *fp) {
       unsigned long size;
       fread(&size, sizeof(unsigned long), 1, fp);
       newptr = aialloc(size, "reading array", 1, -1);
+      fread(newptr, sizeof(char), size, fp);
       root = new PointerMapLink(oldptr, newptr, root);
       break;
     }
@@ -37,6 +39,14 @@ struct BasePointers ReadAllObjects(FILE *fp) {
       root = new PointerMapLink(oldptr, new MemoryWorkspace(fp), root);
       break;
     }
+    case CBigEndianWorkspace: {
+      root = new PointerMapLink(oldptr, new BigEndianWorkspace(fp), root);
+      break;
+    }
+    case CLittleEndianWorkspace: {
+      root = new PointerMapLink(oldptr, new LittleEndianWorkspace(fp), root);
+      break;
+    }
     case CEvolSystemBasic: {
       root = new PointerMapLink(oldptr, new EvolSystemBasic(fp), root);
       break;
@@ -49,6 +59,14 @@ struct BasePointers ReadAllObjects(FILE *fp) {
       root = new PointerMapLink(oldptr, new Coderack(fp), root);
       break;
     }
+    case CFlatCoderack: {
+      root = new PointerMapLink(oldptr, new FlatCoderack(fp), root);
+      break;
+    }
+    case CParallelCoderack: {
+      root = new PointerMapLink(oldptr, new ParallelCoderack(fp), root);
+      break;
+    }
     case CCoderackBranch: {
       root = new PointerMapLink(oldptr, new CoderackBranch(fp), root);
       break;
@@ -122,19 +140,20 @@ struct BasePointers ReadAllObjects(FILE *fp) {
 				root);
       break;
     }
-    case CWorkspaceBond: {
-      fread(&cntdptr, sizeof(void *), 1, fp);
-      WorkspaceRef *ref1 = (WorkspaceRef *) root->FindNewPointer(cntdptr);
-      fread(&cntdptr, sizeof(void *), 1, fp);
-      WorkspaceRef *ref2 = (WorkspaceRef *) root->FindNewPointer(cntdptr);
-      root = new PointerMapLink(oldptr, new WorkspaceBond(fp, *ref1, *ref2),
-				root);
-      break;
-    }
+    case CWorkspaceBond:  /* from before bonds were held by value */
+      verbize(3, "error", "Bond objects in this file are no longer read\n");
+      exit(BADARG_ERROR);
     case CCheckMemory: {
       fread(&cntdptr, sizeof(void *), 1, fp);
       Coderack *cr = (Coderack *) root->FindNewPointer(cntdptr);
       root = new PointerMapLink(oldptr, new CheckMemory(fp, *cr), root);
+      break;
+    }
+    case CCullSystemsCodelet: {
+      fread(&cntdptr, sizeof(void *), 1, fp);
+      Workspace *ws = (Workspace *) root->FindNewPointer(cntdptr);
+      root = new PointerMapLink(oldptr, new CullSystemsCodelet(fp, *ws), root);
+      break;
     }
     case CTextShowWorkspace: {
       fread(&cntdptr, sizeof(void *), 1, fp);
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include "base.h"
+#include "reclaim.h"
+#include "workspace.h"
+
+ReclaimRecord EpochReclaimer::records[RECLAIM_THREADS];
+unsigned EpochReclaimer::recordcount = 0;
+volatile unsigned long EpochReclaimer::epoch = 1;
+
+/* This thread's record, claimed on its first use */
+static __thread ReclaimRecord *self = NULL;
+
+void EpochReclaimer::Enter() {
+  ReclaimRecord *rec = Self();
+
+  if (rec->depth++)
+    return;
+  rec->epoch = (epoch << 1) | 1;
+  __sync_synchronize();  /* seen inside before any element is read */
+}
+
+void EpochReclaimer::Leave() {
+  ReclaimRecord *rec = Self();
+
+  if (--rec->depth)
+    return;
+  __sync_synchronize();  /* done with every element before leaving */
+  rec->epoch = 0;
+  if (rec->count >= RECLAIM_BATCH)
+    Collect(rec);
+}
+
+/* Unthreaded, nothing else can be holding it */
+void EpochReclaimer::Retire(WorkspaceElt *elt) {
+  ReclaimRecord *rec;
+
+  if (!elt)
+    return;
+  if (!aithreaded) {
+    delete elt;
+    return;
+  }
+
+  rec = Self();
+  if (rec->count == rec->room) {
+    rec->room = rec->room ? 2 * rec->room : RECLAIM_BATCH;
+    rec->limbo = (WorkspaceElt **) realloc(rec->limbo, rec->room *
+					   sizeof(WorkspaceElt *));
+    rec->retired = (unsigned long *) realloc(rec->retired, rec->room *
+					     sizeof(unsigned long));
+    if (!rec->limbo || !rec->retired) {
+      verbize(2, "error", "No room to retire elements\n");
+      exit(MEMORY_ERROR);
+    }
+  }
+  rec->limbo[rec->count] = elt;
+  rec->retired[rec->count++] = epoch;
+  if (rec->count >= RECLAIM_BATCH)
+    Collect(rec);
+}
+
+/* Retired elements are unreachable, so CheckMemory drains them first */
+void EpochReclaimer::Drain() {
+  for (unsigned r = 0; r < recordcount; r++) {
+    ReclaimRecord *rec = &records[r];
+
+    for (unsigned i = 0; i < rec->count; i++)
+      delete rec->limbo[i];
+    rec->count = 0;
+  }
+}
+
+unsigned long EpochReclaimer::GetPending() {
+  unsigned long pending = 0;
+
+  for (unsigned r = 0; r < recordcount; r++)
+    pending += records[r].count;
+  return pending;
+}
+
+/* Limbo lists are derived, so kept out of memtrack like the population */
+ReclaimRecord *EpochReclaimer::Self() {
+  unsigned r;
+
+  if (self)
+    return self;
+  r = __sync_fetch_and_add(&recordcount, 1);
+  if (r >= RECLAIM_THREADS) {
+    verbize(2, "error", "More than %d threads reading elements\n",
+	    RECLAIM_THREADS);
+    exit(UNSPEC_ERROR);
+  }
+  self = &records[r];
+  return self;
+}
+
+/* TRUE if the epoch moved on, by us or another thread */
+int EpochReclaimer::Advance() {
+  unsigned long now = epoch, seen;
+
+  for (unsigned r = 0; r < recordcount; r++) {
+    seen = records[r].epoch;
+    if ((seen & 1) && (seen >> 1) != now)
+      return FALSE;
+  }
+  __sync_bool_compare_and_swap(&epoch, now, now + 1);
+  return TRUE;
+}
+
+/* Frees what was retired two epochs back, keeping the rest in order */
+void EpochReclaimer::Collect(ReclaimRecord *rec) {
+  unsigned kept = 0;
+
+  Advance();
+  for (unsigned i = 0; i < rec->count; i++)
+    if (rec->retired[i] + 2 <= epoch)
+      delete rec->limbo[i];
+    else {
+      rec->limbo[kept] = rec->limbo[i];
+      rec->retired[kept++] = rec->retired[i];
+    }
+  rec->count = kept;
+}
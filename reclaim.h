@@ -0,0 +1,44 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#define RECLAIM_THREADS 256  /* most threads that ever read elements */
+#define RECLAIM_BATCH 64     /* retired by a thread before it collects */
+
+class WorkspaceElt;
+
+/* One thread's part: the epoch it is reading in, and what it retired */
+struct ReclaimRecord {
+  volatile unsigned long epoch;  /* (epoch << 1) | 1 inside, 0 outside */
+  unsigned depth;
+  WorkspaceElt **limbo;
+  unsigned long *retired;  /* the epoch each was retired in */
+  unsigned count, room;
+};
+
+/* Epoch-based reclamation for elements taken out of their slots.  A
+   thread reads elements only between Enter() and Leave(); an element
+   replaced in the meantime is retired instead of deleted, and freed
+   two epochs on, when no reader can still hold it.  The epoch moves
+   on only once every thread inside has seen the current one. */
+class EpochReclaimer {
+public:
+  static void Enter();
+  static void Leave();
+  static void Retire(WorkspaceElt *elt);  // -elt
+
+  /* Frees everything retired; only with every reader stopped */
+  static void Drain();
+
+  static unsigned long GetPending();
+
+private:
+  static ReclaimRecord *Self();
+  static int Advance();
+  static void Collect(ReclaimRecord *rec);
+
+  static ReclaimRecord records[RECLAIM_THREADS];
+  static unsigned recordcount;
+  static volatile unsigned long epoch;
+};
+
+#endif
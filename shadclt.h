@@ -30,6 +30,8 @@ public:
 
   virtual WorkspaceElt *GetElement(CNIndex id);
   virtual void SetElement(CNIndex id, const WorkspaceElt &elt);
+  virtual void SetElement(CNIndex id, WorkspaceElt *elt);  // -elt
+  virtual WorkspaceElt *SwapElement(CNIndex id, WorkspaceElt *elt);
 
   virtual WorkspaceRef &SalientElement(CNIndex i);
 
@@ -38,6 +40,8 @@ public:
 private:
   virtual WorkspaceRef &RoomAddElement(WorkspaceElt &elt);
   virtual WorkspaceRef &RoomAddElement(WorkspaceRef &ref);
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceElt &elt);
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceRef &ref);
   virtual void SetSalient(CNIndex i, WorkspaceRef &ref);
 
   int site;
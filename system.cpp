@@ -1,62 +1,108 @@
 #include <math.h>
 #include <sys/types.h>
+#include <string.h>
+#include <pthread.h>
 #include "system.h"
 #include "base.h"
+#include "jit.h"
+#include "memo.h"
+#include "population.h"
 
 #define	ULONG_MAX	4294967295UL	/* max of "unsigned long int" */
 
-#define checkdat() if (datl >= length || datl < 0) { endc = 2; break; }
+#define checkdat() if (datl >= length || datl < 0) { endc = 2; goto next; }
 #define getdata(datl) ((datl < dnalen) ? dna[datl] : pool[datl - dnalen])
 
-unsigned long EvolSystem::systotal = 0;
-unsigned long EvolSystem::agetotal = 0;
+/* A register of each lane of StepLanes; comparisons give 0 or -1 */
+typedef long LaneWord
+  __attribute__ ((vector_size (BATCH_LANES * sizeof(long))));
+#define pick(mask, yes, no) (((mask) & (yes)) | (~(mask) & (no)))
+
+int EvolSystemBasic::jit = FALSE;
+int EvolSystemBasic::lockstep = FALSE;
+static pthread_mutex_t dnalock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t flatlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Each thread's spare genome buffers, by size class, linked through
+   their first bytes; they are kept out of memtrack while spare */
+static __thread unsigned char *sparedna[DNA_POOL_CLASSES];
+static __thread unsigned sparecount[DNA_POOL_CLASSES];
+
+/* A buffer for at least len bytes of dna or pool; room is its size */
+static unsigned char *TakeDna(unsigned len, unsigned &room) {
+  unsigned char *block;
+  unsigned cls = 0;
+
+  for (room = DNA_POOL_MIN; room < len; room *= 2)
+    cls++;
+  if (cls < DNA_POOL_CLASSES && (block = sparedna[cls])) {
+    sparedna[cls] = *((unsigned char **) block);
+    sparecount[cls]--;
+    TrackLink::MemRegister(block, room << TL_FLAG_BITS);
+    return block;
+  }
+
+  return (unsigned char *) aialloc(room, "genome buffer", 1, -3);
+}
+
+static void GiveDna(unsigned char *block, unsigned room) {
+  unsigned cls = 0;
+
+  for (unsigned size = DNA_POOL_MIN; size < room; size *= 2)
+    cls++;
+  if (cls < DNA_POOL_CLASSES && sparecount[cls] < DNA_POOL_KEEP) {
+    TrackLink::MemForget(TrackLink::MemFindLink(block));
+    *((unsigned char **) block) = sparedna[cls];
+    sparedna[cls] = block;
+    sparecount[cls]++;
+  } else
+    aifree(block);
+}
 
 double EvolSystem::GetAverageAge() {
-  return (double) agetotal / (double) systotal;
+  return SystemPopulation::GetAverageAge();
 }
 
 /*****************************************************************************/
 
 EvolSystem::EvolSystem() :
   AIObject(CEvolSystem) {
-  score = 0;
-  totalinst = 0;
-  predictions = 0;
-  credfact = INIT_CRED;
+  slot = SystemPopulation::Join(this);
+  cell = SystemPopulation::GetChunk(slot);
+  cellat = slot % POP_CHUNK;
+  cell->credfact[cellat] = INIT_CRED;
   refcount = 0;
-  age = 0;
-  systotal++;
 }
 
 EvolSystem::EvolSystem(FILE *fp) :
   AIObject(fp) {
-  fread(&score, sizeof(unsigned long), 1, fp);
-  fread(&predictions, sizeof(unsigned long), 1, fp);
-  fread(&totalinst, sizeof(unsigned long), 1, fp);
-  fread(&age, sizeof(unsigned long), 1, fp);
-  fread(&credfact, sizeof(float), 1, fp);
+  slot = SystemPopulation::Join(this);
+  cell = SystemPopulation::GetChunk(slot);
+  cellat = slot % POP_CHUNK;
+  fread(&cell->score[cellat], sizeof(unsigned long), 1, fp);
+  fread(&cell->predictions[cellat], sizeof(unsigned long), 1, fp);
+  fread(&cell->totalinst[cellat], sizeof(unsigned long), 1, fp);
+  fread(&cell->age[cellat], sizeof(unsigned long), 1, fp);
+  fread(&cell->credfact[cellat], sizeof(float), 1, fp);
   fread(&refcount, sizeof(unsigned), 1, fp);
-  agetotal += age;
-  systotal++;
 }
 
 EvolSystem::~EvolSystem() {
   verbize(-5, "debug", "Destroying System %ld\n", this);
-  agetotal -= age;
-  systotal--;
+  SystemPopulation::Leave(slot);
   type = CDeletedClass;
 }
 
 float EvolSystem::Credibility() {
-  if (predictions && score)
-    return credfact * ((float) score) / ((float) predictions);
-  if (predictions)
-    return credfact / predictions;
-  return credfact;
+  return SystemPopulation::GetCredibility(cell, cellat);
+}
+
+int EvolSystem::Culled() const {
+  return cell->culled[cellat];
 }
 
 void EvolSystem::Weaken() {
-  credfact *= .9;
+  cell->credfact[cellat] *= .9;
 }
 
 void EvolSystem::Weaken(Confidence cred) {
@@ -64,13 +110,13 @@ void EvolSystem::Weaken(Confidence cred) {
     verbize(2, "error", "Credibility %f > 1.!\n", cred);
     exit(-2);
   }
-  credfact *= sqrt(1. - cred);
+  cell->credfact[cellat] *= sqrt(1. - cred);
 }
 
 void EvolSystem::Strengthen() {
-  credfact *= 1.11;
-  if (credfact > 1.)
-    credfact = 1.;
+  cell->credfact[cellat] *= 1.11;
+  if (cell->credfact[cellat] > 1.)
+    cell->credfact[cellat] = 1.;
 }
 
 void EvolSystem::Strengthen(Confidence cred) {
@@ -78,32 +124,88 @@ void EvolSystem::Strengthen(Confidence cred) {
     verbize(2, "error", "Credibility %f > 1.!\n", cred);
     exit(-2);
   }
-  credfact *= sqrt(1. + cred);
-  if (credfact > 1.)
-    credfact = 1.;
+  cell->credfact[cellat] *= sqrt(1. + cred);
+  if (cell->credfact[cellat] > 1.)
+    cell->credfact[cellat] = 1.;
 }
 
 void EvolSystem::AddReference() {
-  refcount++;
+  unsigned now;
+
+  if (aithreaded)
+    now = __sync_add_and_fetch(&refcount, 1);
+  else
+    now = ++refcount;
+#if REFCOUNT_VERBIZE
   verbize(-6, "refcount", "Increasing reference for %ld to %d\n", this,
-	  refcount);
+	  now);
+#endif
 }
 
 void EvolSystem::RemoveReference() {
-  refcount--;
+  unsigned left;
+
+  if (aithreaded)
+    left = __sync_sub_and_fetch(&refcount, 1);
+  else
+    left = --refcount;
+#if REFCOUNT_VERBIZE
   verbize(-6, "refcount", "Decreasing reference for %ld to %d\n", this,
-	  refcount);
-  if (refcount <= 0)
+	  left);
+#endif
+  if (left <= 0)
     delete this;
 }
 
+/* With lockstep, genomes that never write go BATCH_LANES at a time
+   through StepLanes, once for upexec and once for dnexec; towers and
+   genomes that write run alone */
+void EvolSystem::ExecuteBatch(EvolSystem **systems, unsigned count,
+			      char input, char *predictions) {
+  EvolSystemBasic *lanes[BATCH_LANES];
+  unsigned which[BATCH_LANES];
+  unsigned char accus[BATCH_LANES];
+  unsigned filled = 0;
+
+  for (unsigned at = 0; at < count; at++) {
+    if (EvolSystemBasic::lockstep && systems[at]->type == CEvolSystemBasic &&
+	((EvolSystemBasic *) systems[at])->Batchable()) {
+      lanes[filled] = (EvolSystemBasic *) systems[at];
+      which[filled++] = at;
+    } else
+      predictions[at] = systems[at]->execute(input);
+
+    if (filled == BATCH_LANES || (filled && at + 1 == count)) {
+      for (unsigned lane = 0; lane < filled; lane++)
+	accus[lane] = input;
+      EvolSystemBasic::StepLanes(lanes, filled, accus);
+      EvolSystemBasic::StepLanes(lanes, filled, accus);
+      for (unsigned lane = 0; lane < filled; lane++)
+	predictions[which[lane]] = accus[lane];
+      filled = 0;
+    }
+  }
+}
+
+/* One more prediction for this system alone */
+void EvolSystem::Tally(int success) {
+  if (cell->predictions[cellat] < ULONG_MAX) {
+    if (success)
+      cell->score[cellat]++;
+    cell->predictions[cellat]++;
+  }
+  cell->age[cellat]++;
+}
+
 int EvolSystem::WriteObject(FILE *fp) {
   size_t result = AIObject::WriteObject(fp);
-  result = fwrite(&score, sizeof(unsigned long), 1, fp) + result;
-  result = fwrite(&predictions, sizeof(unsigned long), 1, fp) + result;
-  result = fwrite(&totalinst, sizeof(unsigned long), 1, fp) + result;
-  result = fwrite(&age, sizeof(unsigned long), 1, fp) + result;
-  result = fwrite(&credfact, sizeof(float), 1, fp) + result;
+  result = fwrite(&cell->score[cellat], sizeof(unsigned long), 1, fp) + result;
+  result = fwrite(&cell->predictions[cellat], sizeof(unsigned long), 1, fp) +
+    result;
+  result = fwrite(&cell->totalinst[cellat], sizeof(unsigned long), 1, fp) +
+    result;
+  result = fwrite(&cell->age[cellat], sizeof(unsigned long), 1, fp) + result;
+  result = fwrite(&cell->credfact[cellat], sizeof(float), 1, fp) + result;
   return fwrite(&refcount, sizeof(unsigned), 1, fp) + result;
 }
 
@@ -115,42 +217,78 @@ EvolSystemBasic::EvolSystemBasic() {
   type = CEvolSystemBasic;
   pristine = NULL;
 
-  dna = NULL;
+  dna = dnabuff;
+  dnaroom = DNA_INLINE;
+  dnashare = NULL;
   pool = NULL;
   dnalen = length = 0;
   poolsize = 0;
 
   dnal = datl = 0;
   side = 0;
+  InitOps();
 
   TrackLink::MemStore(trackid, pristine.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &dna, FALSE);
+  TrackLink::MemStore(trackid, &dnashare, FALSE);
   TrackLink::MemStore(trackid, &pool, FALSE);
 }
 
 EvolSystemBasic::EvolSystemBasic(FILE *fp) :
   EvolSystem(fp) {
+  unsigned stored;
+
   fread(pristine.GetSystemPP(), sizeof(EvolSystemBasic *), 1, fp);
-  fread(&dnalen, sizeof(unsigned), 1, fp);
+  dna = dnabuff;
+  dnaroom = DNA_INLINE;
+  dnashare = NULL;
+  dnalen = poolsize = 0;
+  pool = NULL;
+  fread(&stored, sizeof(unsigned), 1, fp);
+  PlaceDna(stored, FALSE);
+  dnalen = stored;
   fread(dna, sizeof(unsigned char), dnalen, fp);
-  fread(&poolsize, sizeof(unsigned), 1, fp);
-  fread(pool, sizeof(unsigned char), poolsize, fp);
+  fread(&stored, sizeof(unsigned), 1, fp);
+  if (stored)
+    GrowPool(stored);
+  fread(pool, sizeof(unsigned char), stored, fp);
   fread(&length, sizeof(unsigned), 1, fp);
   fread(&dnal, sizeof(long), 1, fp);
   fread(&datl, sizeof(long), 1, fp);
   fread(&side, sizeof(char), 1, fp);
+  InitOps();
 
   TrackLink::MemStore(trackid, pristine.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &dna, FALSE);
+  TrackLink::MemStore(trackid, &dnashare, FALSE);
   TrackLink::MemStore(trackid, &pool, FALSE);
 }
 
 EvolSystemBasic::~EvolSystemBasic() {
   verbize(-5, "debug", "killing of basic: %ld\n", this);
-  if (dna)
-    aifree(dna);
+  if (aithreaded)
+    pthread_mutex_lock(&dnalock);
+  if (dnashare && --dnashare->refs) {
+    dna = NULL;  /* kin still read it */
+    if (ops == dnashare->ops)
+      ops = NULL;
+    if (native == dnashare->native)
+      native = NULL;
+  } else if (dnashare) {
+    if (dnashare->ops != ops)
+      aifree(dnashare->ops);
+    if (dnashare->native != native)
+      delete dnashare->native;
+    aifree(dnashare);
+  }
+  dnashare = NULL;
+  if (aithreaded)
+    pthread_mutex_unlock(&dnalock);
+  if (dna && dna != dnabuff)
+    GiveDna(dna, dnaroom);
   if (pool)
-    aifree(pool);
+    GiveDna(pool, poolsize);
+  if (ops)
+    aifree(ops);
+  DropNative();
   type = CDeletedClass;
 }
 
@@ -169,12 +307,15 @@ void EvolSystemBasic::mutate() {
 
   /* Allocate new dna array */
   if (newlen != dnalen)
-    dna = (unsigned char *) airealloc(dna, newlen, "mutate dna array", 1, -2);
+    OwnDna(newlen);
 
   /* Copy dna, introducing errors */
   for (unsigned base = 0; base < min(dnalen, newlen); base++) {
-    if (!random(sqrt(dnalen)))
+    if (!random(sqrt(dnalen))) {
+      if (dnashare)
+	OwnDna(newlen);
       dna[base] = random(256);
+    }
   }
 
   /* If dna is longer, fill with random bytes */
@@ -183,14 +324,19 @@ void EvolSystemBasic::mutate() {
 
   length += newlen - dnalen;
   dnalen = newlen;
+  opsvalid = FALSE;
+  hashvalid = FALSE;
+  DropNative();
+  runs = 0;
+  nativeoff = FALSE;
 }
 
 EvolSystemPtr EvolSystemBasic::reproduce() {
   verbize(-5, "debug", "Reproducing basic-noprob- %ld\n", this);
 
-  if (score > 0 || !pristine.GetSystem()) {
+  if (cell->score[cellat] > 0 || !pristine.GetSystem()) {
     if (pristine.GetSystem())
-      score--;
+      cell->score[cellat]--;
     return new EvolSystemBasic(this);
   }
   return NULL;
@@ -199,10 +345,10 @@ EvolSystemPtr EvolSystemBasic::reproduce() {
 EvolSystemPtr EvolSystemBasic::reproduce(float prob) {
   verbize(-5, "debug", "Reproducing basic %ld\n", this);
 
-  if (score > 0 || !pristine.GetSystem()) {
+  if (cell->score[cellat] > 0 || !pristine.GetSystem()) {
     if (frand() < prob) {
       if (pristine.GetSystem()) {
-	score--;
+	cell->score[cellat]--;
 	verbize(-6, "debug", "Reproducing off pristine %ld\n", pristine.GetSystem());
 	return pristine->reproduce();
       } else
@@ -221,23 +367,26 @@ char EvolSystemBasic::execute(char input) {
 }
 
 void EvolSystemBasic::PredFailure() {
-  if (predictions < ULONG_MAX)
-    predictions++;
-  age++;
-  agetotal++;
+  Tally(FALSE);
 }
 
 void EvolSystemBasic::PredSuccess() {
-  if (predictions < ULONG_MAX) {
-    score++;
-    predictions++;
-  }
-  age++;
-  agetotal++;
+  Tally(TRUE);
+}
+
+int EvolSystemBasic::Expired() const {
+  return cell->predictions[cellat] > SYSTEM_MAX_LIFE || cell->culled[cellat];
+}
+
+void EvolSystemBasic::GetRegisters(long *dnaloc, long *datloc,
+				   char *sideloc) const {
+  *dnaloc = dnal;
+  *datloc = datl;
+  *sideloc = side;
 }
 
 EvolSystemPtr EvolSystemBasic::CheckLife() {
-  if (predictions > SYSTEM_MAX_LIFE) {
+  if (Expired()) {
     verbize(-7, "debug", "RR: Basic CheckLife %ld\n", this);
     return NULL;
   } else
@@ -248,7 +397,11 @@ EvolSystemBasic::EvolSystemBasic(unsigned char *newdna, unsigned newlen) {
   pristine = NULL;
   type = CEvolSystemBasic;
 
-  dna = (unsigned char *) aialloc(newlen, "making offspring", 1, -1);
+  dna = dnabuff;
+  dnaroom = DNA_INLINE;
+  dnalen = 0;
+  PlaceDna(newlen, FALSE);
+  dnashare = NULL;
 
   for (int base = 0; base < newlen; base++)
     dna[base] = newdna[base];
@@ -257,9 +410,10 @@ EvolSystemBasic::EvolSystemBasic(unsigned char *newdna, unsigned newlen) {
   length = dnalen = newlen;
 
   dnal = datl = side = 0;
+  InitOps();
 
   TrackLink::MemStore(trackid, pristine.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &dna, FALSE);
+  TrackLink::MemStore(trackid, &dnashare, FALSE);
   TrackLink::MemStore(trackid, &pool, FALSE);
 }
 
@@ -268,11 +422,21 @@ EvolSystemBasic::EvolSystemBasic(EvolSystemBasicPtr prist) {
 
   type = CEvolSystemBasic;
 
-  //EvolSystemBasic(prist->dna, prist->length);
-  dna = (unsigned char *) aialloc(prist->length, "making offspring", 1, -1);
-
-  for (int base = 0; base < prist->length; base++)
-    dna[base] = (prist->dna)[base];
+  /* Written-to pools aren't shared, nor is dna held inside prist;
+     those genomes are copied whole */
+  dna = dnabuff;
+  dnaroom = DNA_INLINE;
+  dnashare = NULL;
+  dnalen = 0;
+  InitOps();
+  if (prist->length == prist->dnalen && prist->dna != prist->dnabuff)
+    ShareDna(prist.GetSystemBasic());
+  else {
+    PlaceDna(prist->length, FALSE);
+    for (unsigned base = 0; base < prist->length; base++)
+      dna[base] = base < prist->dnalen ? prist->dna[base] :
+	prist->pool[base - prist->dnalen];
+  }
   pool = NULL;
   poolsize = 0;
   length = dnalen = prist->length;
@@ -282,7 +446,7 @@ EvolSystemBasic::EvolSystemBasic(EvolSystemBasicPtr prist) {
   dnal = datl = side = 0;
 
   TrackLink::MemStore(trackid, pristine.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &dna, FALSE);
+  TrackLink::MemStore(trackid, &dnashare, FALSE);
   TrackLink::MemStore(trackid, &pool, FALSE);
 }
 
@@ -291,7 +455,16 @@ char EvolSystemBasic::upexec(char input) {
   return dnexec(input);
 }
 
+/* Direct-threaded over the decoded opcodes (a GNU C++ extension); once
+   hot, runs of opcodes go through native code between interpreted ones.
+   Runs that don't write are remembered, and repeats taken from there. */
 char EvolSystemBasic::dnexec(char input) {
+  static void *dispatch[16] = {
+    &&op_test, &&op_read, &&op_write, &&op_io, &&op_setdat, &&op_getdat,
+    &&op_datdown, &&op_datup, &&op_movedat, &&op_add, &&op_and, &&op_or,
+    &&op_xor, &&op_not, &&op_shiftl, &&op_shiftr
+  };
+
   verbize(-7, "debug", "Dnexec on basic %ld\n", this);
 
   /* Meta-AI structure */
@@ -299,121 +472,485 @@ char EvolSystemBasic::dnexec(char input) {
 
   int curr;  /* current instruction */
 
-  int endc;  /* flag for completion of prediction */
+  int endc = 0;  /* flag for completion of prediction */
 
-  long base;
-  unsigned char temp;
   long tmpl;
 
+  JitState state;
+  char stepped = FALSE;  /* native code just handed back */
+  unsigned at;
+
+  MemoRun run;
+  char memo = PredictionCache::enabled && length == dnalen && dnalen;
+  char wrote = FALSE;
+
   /* AI Variables */
   unsigned char accu;       /* Accumulator */
 
   /* Begin Prediction for input file */
   accu = input;
 
+  if (memo) {
+    if (!hashvalid) {
+      dnahash = PredictionCache::HashDna(dna, dnalen);
+      hashvalid = TRUE;
+    }
+    run.dnahash = dnahash;
+    run.dnalen = dnalen;
+    run.dnal = dnal;
+    run.datl = datl;
+    run.side = side;
+    run.input = input;
+    if (PredictionCache::Lookup(run)) {
+      dnal = run.outdnal;
+      datl = run.outdatl;
+      side = run.outside;
+      accu = run.accu;
+      endc = run.endc;
+      inst = MAX_PER_CHAR;
+      cell->totalinst[cellat] += MAX_PER_CHAR;
+      memo = FALSE;
+      goto done;
+    }
+  }
+
+  if (!opsvalid)
+    DecodeOps();
+  if (jit && !native && !nativeoff && ++runs >= JIT_THRESHOLD)
+    CompileNative();
+
   /* Predict the next character */
-  for (; inst < MAX_PER_CHAR; inst++, totalinst++) {
+ next:
+  if (inst == MAX_PER_CHAR)
+    goto done;
+  if (native && !stepped && dnal < length) {
+    state.datl = datl;
+    state.budget = MAX_PER_CHAR - inst;
+    state.endc = endc;
+    state.accu = accu;
+    at = native->Run(2 * dnal + side, &state);
+    cell->totalinst[cellat] += MAX_PER_CHAR - inst - state.budget;
+    inst = MAX_PER_CHAR - state.budget;
+    datl = state.datl;
+    endc = state.endc;
+    accu = state.accu;
+    dnal = at / 2;
+    side = at % 2;
+    stepped = TRUE;
+    goto next;
+  }
+  stepped = FALSE;
+  inst++;
+  cell->totalinst[cellat]++;
+
+  /* Get the next instruction */
+  if (dnal >= length) {
+    dnal = side = 0;
+    curr = ops[0];
+  } else {
+    curr = ops[2 * dnal + side];
+    dnal += side;
+    side ^= 1;
+  }
+  goto *dispatch[curr];
+
+  /* Execute instruction */
+ op_test:   /* Test conditional-jump */
+  if (accu) {
+    checkdat();
+    tmpl = dnal;
+    dnal = datl;
+    datl = tmpl;
+  }
+  goto next;
+ op_read:   /* Read */
+  checkdat();
+  accu = getdata(datl);
+  datl++;
+  goto next;
+ op_write:   /* Write */
+  wrote = TRUE;
+  hashvalid = FALSE;
+  DropNative();
+  nativeoff = TRUE;
+  if (datl == length)
+    length++;
+  checkdat();
+  if (datl < dnalen) {
+    if (dnashare)
+      OwnDna(dnalen);
+    if (!opsvalid)
+      DecodeOps();
+    dna[datl] = accu;
+    DecodeByte(datl++);
+  } else {
+    if (poolsize < length - dnalen)
+      GrowPool(length - dnalen);
+    pool[datl - dnalen] = accu;
+    OwnOps();
+    DecodeByte(datl);
+    datl += 2;
+  }
+  goto next;
+ op_io:   /* I/O with accumulator */
+  endc = 1;
+  goto next;
+ op_setdat:  /* Set DAT to accu */
+  datl = accu;
+  goto next;
+ op_getdat:  /* Set accu to first byte of DAT */
+  accu = datl % 256;
+  goto next;
+ op_datdown:  /* Move DAT by a byte, down */
+  datl >>= 8;
+  goto next;
+ op_datup:  /* Move DAT by a byte, up */
+  datl <<= 8;
+  goto next;
+ op_movedat:  /* Change Data pointer */
+  datl += accu;
+  goto next;
+ op_add: /* Add to accumulator */
+  checkdat();
+  accu += getdata(datl);
+  goto next;
+ op_and: /* Bitwise AND with accumulator */
+  checkdat();
+  accu &= getdata(datl);
+  goto next;
+ op_or: /* Bitwise OR with accumulator */
+  checkdat();
+  accu |= getdata(datl);
+  goto next;
+ op_xor: /* Bitwise XOR with accumulator */
+  checkdat();
+  accu ^= getdata(datl);
+  goto next;
+ op_not: /* Bitwise NOT of accumulator */
+  accu = ~accu;
+  goto next;
+ op_shiftl: /* Bitwise shift left */
+  accu <<= 1;
+  goto next;
+ op_shiftr: /* Bitwise shift right */
+  accu >>= 1;
+  goto next;
+
+ done:
+  if (memo && !wrote) {
+    run.outdnal = dnal;
+    run.outdatl = datl;
+    run.outside = side;
+    run.accu = accu;
+    run.endc = endc;
+    PredictionCache::Store(run);
+  }
+
+  if (--endc || inst == MAX_PER_CHAR) {
+    if (cell->predictions[cellat] < ULONG_MAX / 2 - 1)  /* will quickly kill */
+      cell->predictions[cellat] = cell->predictions[cellat] * 2 + 1;
+    if (cell->score[cellat] > 0)
+      cell->score[cellat]--;
+  }
+
+  return accu;
+}
 
+int EvolSystemBasic::Batchable() {
+  if (!opsvalid)
+    DecodeOps();
+  return !memchr(ops, 2, 2 * length);
+}
+
+/* dnexec, with every lane working out each opcode and keeping the one
+   it fetched.  Each run is exactly MAX_PER_CHAR opcodes, so the lanes
+   never part; only the fetches and reads are done lane by lane.  No
+   genome may write, and the prediction cache and native code are left
+   out.  Lanes past count repeat the first genome and are dropped. */
+void EvolSystemBasic::StepLanes(EvolSystemBasic **genomes, unsigned count,
+				unsigned char *accus) {
+  EvolSystemBasic *sys[BATCH_LANES];
+  LaneWord accu, dnal, datl, side, length, curr, data;
+  LaneWord wrap, inside, mask, tmpl;
+  unsigned lane;
+
+  for (lane = 0; lane < BATCH_LANES; lane++) {
+    sys[lane] = genomes[lane < count ? lane : 0];
+    accu[lane] = accus[lane < count ? lane : 0];
+    dnal[lane] = sys[lane]->dnal;
+    datl[lane] = sys[lane]->datl;
+    side[lane] = sys[lane]->side;
+    length[lane] = sys[lane]->length;
+  }
+
+  for (unsigned inst = 0; inst < MAX_PER_CHAR; inst++) {
     /* Get the next instruction */
-    if (dnal >= length) {
-      dnal = side = 0;
-      curr = getdata(0) % 16;
-    } else {
-      if (!side)
-	curr = getdata(dnal) % 16;
-      else {
-	curr = getdata(dnal) >> 4;
-	dnal++;
-      }
-      side = (side + 1) % 2;
+    wrap = dnal >= length;
+    for (lane = 0; lane < BATCH_LANES; lane++)
+      curr[lane] =
+	sys[lane]->ops[wrap[lane] ? 0 : 2 * dnal[lane] + side[lane]];
+    dnal = (dnal + side) & ~wrap;
+    side = (side ^ 1) & ~wrap;
+
+    inside = (datl >= 0) & (datl < length);
+    for (lane = 0; lane < BATCH_LANES; lane++) {
+      EvolSystemBasic *at = sys[lane];
+
+      data[lane] = !inside[lane] ? 0 : datl[lane] < at->dnalen ?
+	at->dna[datl[lane]] : at->pool[datl[lane] - at->dnalen];
     }
 
-    /* Execute instruction */
-    switch (curr) {
-    case (0):   /* Test conditional-jump */
-      if (accu) {
-	checkdat();
-	tmpl = dnal;
-	dnal = datl;
-	datl = tmpl;
-      }
-      break;
-    case (1):   /* Read */
-      checkdat();
-      accu = getdata(datl);
-      datl++;
-      break;
-    case (2):   /* Write */
-      if (datl == length)
-	length++;
-      checkdat();
-      if (datl < dnalen)
-	dna[datl++] = accu;
-      else {
-	if (poolsize < length - dnalen) {
-	  pool = (unsigned char *) airealloc(pool, poolsize = 2 * poolsize + 1,
-					     "Allocating a pool", 1, -3);
-	}
-	pool[datl++ - dnalen] = accu;
-	datl++;
+    /* Those that need data outside the genome do nothing */
+    mask = (curr == 0) & (accu != 0) & inside;  /* test */
+    tmpl = dnal;
+    dnal = pick(mask, datl, dnal);
+    datl = pick(mask, tmpl, datl);
+    mask = (curr == 1) & inside;  /* read */
+    accu = pick(mask, data, accu);
+    datl = pick(mask, datl + 1, datl);
+    datl = pick(curr == 4, accu, datl);  /* setdat */
+    accu = pick(curr == 5, datl & 255, accu);  /* getdat */
+    datl = pick(curr == 6, datl >> 8, datl);  /* datdown */
+    datl = pick(curr == 7, datl << 8, datl);  /* datup */
+    datl = pick(curr == 8, datl + accu, datl);  /* movedat */
+    accu = pick((curr == 9) & inside, (accu + data) & 255, accu);
+    accu = pick((curr == 10) & inside, accu & data, accu);
+    accu = pick((curr == 11) & inside, accu | data, accu);
+    accu = pick((curr == 12) & inside, accu ^ data, accu);
+    accu = pick(curr == 13, ~accu & 255, accu);
+    accu = pick(curr == 14, (accu << 1) & 255, accu);
+    accu = pick(curr == 15, accu >> 1, accu);
+  }
+
+  /* A run always ends on its last opcode, so dnexec always counts it */
+  for (lane = 0; lane < count; lane++) {
+    EvolSystemBasic *at = sys[lane];
+
+    at->dnal = dnal[lane];
+    at->datl = datl[lane];
+    at->side = side[lane];
+    accus[lane] = accu[lane];
+
+    at->cell->totalinst[at->cellat] += MAX_PER_CHAR;
+    if (at->cell->predictions[at->cellat] < ULONG_MAX / 2 - 1)
+      at->cell->predictions[at->cellat] =
+	at->cell->predictions[at->cellat] * 2 + 1;
+    if (at->cell->score[at->cellat] > 0)
+      at->cell->score[at->cellat]--;
+  }
+}
+
+void EvolSystemBasic::InitOps() {
+  ops = NULL;
+  opsroom = 0;
+  opsvalid = FALSE;
+  hashvalid = FALSE;
+  native = NULL;
+  runs = 0;
+  nativeoff = FALSE;
+  TrackLink::MemStore(trackid, &ops, FALSE);
+}
+
+/* Splits each byte of dna and pool into its low and high opcodes; kin
+   still sharing dna decode it once between them */
+void EvolSystemBasic::DecodeOps() {
+  char publish = FALSE;
+
+  if (dnashare && length == dnalen) {
+    if (aithreaded)
+      pthread_mutex_lock(&dnalock);
+    if (dnashare->ops) {
+      if (ops != dnashare->ops) {
+	if (ops)
+	  aifree(ops);
+	ops = dnashare->ops;
+	opsroom = dnashare->opsroom;
       }
-      break;
-    case (3):   /* I/O with accumulator */
-      endc = 1;
-      break;
-    case (4):  /* Set DAT to accu */
-      datl = accu;
-      break;
-    case (5):  /* Set accu to first byte of DAT */
-      accu = datl % 256;
-      break;
-    case (6):  /* Move DAT by a byte, down */
-      datl >>= 8;
-      break;
-    case (7):  /* Move DAT by a byte, up */
-      datl <<= 8;
-      break;
-    case (8):  /* Change Data pointer */
-      datl += accu;
-      break;
-    case (9): /* Add to accumulator */
-      checkdat();
-      accu += getdata(datl);
-      break;
-    case (10): /* Bitwise AND with accumulator */
-      checkdat();
-      accu &= getdata(datl);
-      break;
-    case (11): /* Bitwise OR with accumulator */
-      checkdat();
-      accu |= getdata(datl);
-      break;
-    case (12): /* Bitwise XOR with accumulator */
-      checkdat();
-      accu ^= getdata(datl);
-      break;
-    case (13): /* Bitwise NOT of accumulator */
-      accu = ~accu;
-      break;
-    case (14): /* Bitwise shift left */
-      accu <<= 1;
-      break;
-    case (15): /* Bitwise shift right */
-      accu >>= 1;
-      break;
-    case (EOF): /* End of DNA */
-      break;
+      if (aithreaded)
+	pthread_mutex_unlock(&dnalock);
+      opsvalid = TRUE;
+      return;
     }
+    publish = TRUE;
+  } else
+    OwnOps();
+
+  if (opsroom < 2 * length || !opsroom) {
+    opsroom = length ? 2 * length : 2;
+    ops = (unsigned char *) airealloc(ops, opsroom, "decoded opcodes", 1, -3);
+  }
+  ops[0] = 0;  /* an empty genome only tests */
+  for (unsigned at = 0; at < length; at++)
+    DecodeByte(at);
+  opsvalid = TRUE;
+
+  if (publish) {
+    dnashare->ops = ops;
+    dnashare->opsroom = opsroom;
+    if (aithreaded)
+      pthread_mutex_unlock(&dnalock);
   }
+}
 
-  if (--endc || inst == MAX_PER_CHAR) {
-    if (predictions < ULONG_MAX / 2 - 1)
-      predictions = predictions * 2 + 1; /* will quickly kill */
-    if (score > 0)
-      score--;
+/* After a write; dnexec only ever grows length by one byte at a time */
+void EvolSystemBasic::DecodeByte(long at) {
+  if (2 * at + 2 > opsroom) {
+    opsroom = 2 * opsroom > 2 * at + 2 ? 2 * opsroom : 2 * at + 2;
+    ops = (unsigned char *) airealloc(ops, opsroom, "decoded opcodes", 1, -3);
+  }
+  ops[2 * at] = getdata(at) % 16;
+  ops[2 * at + 1] = getdata(at) >> 4;
+}
+
+/* Reads from's dna in place, as offspring do until they mutate, along
+   with whatever opcodes and native code from already has for it */
+void EvolSystemBasic::ShareDna(EvolSystemBasic *from) {
+  if (aithreaded)
+    pthread_mutex_lock(&dnalock);
+  if (!from->dnashare) {
+    DnaShare *share = (DnaShare *) aialloc(sizeof(DnaShare), "dna sharing",
+					   1, -3);
+
+    share->refs = 1;
+    share->ops = from->opsvalid ? from->ops : NULL;
+    share->opsroom = share->ops ? from->opsroom : 0;
+    share->native = from->native;
+    TrackLink::MemStore(TrackLink::MemFindLink(share), &share->ops, FALSE);
+    from->dnashare = share;
+  }
+  from->dnashare->refs++;
+  if (dna == dnabuff)
+    TrackLink::MemStore(trackid, &dna, FALSE);
+  dna = from->dna;
+  dnaroom = from->dnaroom;
+  dnashare = from->dnashare;
+  ops = dnashare->ops;
+  opsroom = dnashare->opsroom;
+  opsvalid = (ops != NULL);
+  native = dnashare->native;
+  if (aithreaded)
+    pthread_mutex_unlock(&dnalock);
+}
+
+/* Before dna is written: a private copy, resized to newlen.  Kin keep
+   the opcodes and native code; the last one takes them over. */
+void EvolSystemBasic::OwnDna(unsigned newlen) {
+  if (aithreaded)
+    pthread_mutex_lock(&dnalock);
+  if (dnashare && dnashare->refs > 1) {
+    dnashare->refs--;
+    PlaceDna(newlen, TRUE);
+    if (ops && ops == dnashare->ops) {
+      ops = NULL;
+      opsroom = 0;
+      opsvalid = FALSE;
+    }
+    if (native == dnashare->native)
+      native = NULL;
+  } else {
+    if (dnashare) {
+      if (dnashare->ops != ops)
+	aifree(dnashare->ops);
+      if (dnashare->native != native)
+	delete dnashare->native;
+      aifree(dnashare);
+    }
+    PlaceDna(newlen, FALSE);
+  }
+  dnashare = NULL;
+  if (aithreaded)
+    pthread_mutex_unlock(&dnalock);
+}
+
+/* Before ops is written: a private copy of kin's */
+void EvolSystemBasic::OwnOps() {
+  if (!dnashare || !ops || ops != dnashare->ops)
+    return;
+
+  unsigned char *mine = (unsigned char *) aialloc(opsroom, "decoded opcodes",
+						  1, -3);
+  memcpy(mine, ops, opsroom);
+  ops = mine;
+}
+
+/* Gives dna room for newlen bytes, keeping what it holds; dna still
+   read by kin (shared) is copied from rather than given back */
+void EvolSystemBasic::PlaceDna(unsigned newlen, int shared) {
+  unsigned char *old = dna, *mine = dnabuff;
+  unsigned room = DNA_INLINE;
+
+  if (!shared && newlen <= dnaroom)
+    return;
+
+  if (newlen > DNA_INLINE)
+    mine = TakeDna(newlen, room);
+  if (mine != old)
+    memcpy(mine, old, min(dnalen, newlen));
+  if (old != dnabuff && !shared)
+    GiveDna(old, dnaroom);
+
+  /* memtrack follows dna only while it points off this system */
+  if (old == dnabuff && mine != dnabuff)
+    TrackLink::MemStore(trackid, &dna, FALSE);
+  else if (old != dnabuff && mine == dnabuff)
+    TrackLink::MemRemove(trackid, &dna);
+  dna = mine;
+  dnaroom = room;
+}
+
+/* Room for at least need bytes of pool, at least doubling it */
+void EvolSystemBasic::GrowPool(unsigned need) {
+  unsigned room;
+  unsigned char *bigger = TakeDna(need > 2 * poolsize ? need : 2 * poolsize,
+				  room);
+
+  if (pool) {
+    memcpy(bigger, pool, poolsize);
+    GiveDna(pool, poolsize);
+  }
+  pool = bigger;
+  poolsize = room;
+}
+
+/* Kin still sharing dna compile it once between them */
+void EvolSystemBasic::CompileNative() {
+  GenomeCode *mine;
+
+  if (dnashare && ops == dnashare->ops) {
+    if (aithreaded)
+      pthread_mutex_lock(&dnalock);
+    native = dnashare->native;
+    if (aithreaded)
+      pthread_mutex_unlock(&dnalock);
+    if (native)
+      return;
   }
 
-  return accu;
+  if (!(mine = GenomeCode::Compile(ops, 2 * length, dna, dnalen))) {
+    nativeoff = TRUE;
+    return;
+  }
+  if (dnashare && ops == dnashare->ops) {
+    if (aithreaded)
+      pthread_mutex_lock(&dnalock);
+    if (dnashare->native)
+      delete mine;  /* kin got there first */
+    else
+      dnashare->native = mine;
+    native = dnashare->native;
+    if (aithreaded)
+      pthread_mutex_unlock(&dnalock);
+  } else
+    native = mine;
+}
+
+/* Native code kin share stays theirs */
+void EvolSystemBasic::DropNative() {
+  if (native) {
+    if (!dnashare || native != dnashare->native)
+      delete native;
+    native = NULL;
+  }
 }
 
 int EvolSystemBasic::AssertValid() {
@@ -450,8 +987,8 @@ unsigned EvolSystemBasic::GetTotalSysCount() {
 EvolSystemCombo::EvolSystemCombo(EvolSystemPtr top, EvolSystemPtr bot) {
   type = CEvolSystemCombo;
 
-  above = top;
-  below = bot;
+  above.Swap(top);
+  below.Swap(bot);
 
   if (above.GetSystem() == below.GetSystem()) {
     verbize(2, "error", "Got the impossible condition for %ld.\n",
@@ -459,21 +996,30 @@ EvolSystemCombo::EvolSystemCombo(EvolSystemPtr top, EvolSystemPtr bot) {
     exit(-3);
   }    
 
+  flat = NULL;
+  flatcount = leafcount = 0;
+
   TrackLink::MemStore(trackid, above.GetSystemPP(), FALSE);
   TrackLink::MemStore(trackid, below.GetSystemPP(), FALSE);
+  TrackLink::MemStore(trackid, &flat, FALSE);
 }
 
 EvolSystemCombo::EvolSystemCombo(FILE *fp) :
   EvolSystem(fp) {
   fread(above.GetSystemPP(), sizeof(EvolSystem *), 1, fp);
   fread(below.GetSystemPP(), sizeof(EvolSystem *), 1, fp);
+  flat = NULL;
+  flatcount = leafcount = 0;
 
   TrackLink::MemStore(trackid, above.GetSystemPP(), FALSE);
   TrackLink::MemStore(trackid, below.GetSystemPP(), FALSE);
+  TrackLink::MemStore(trackid, &flat, FALSE);
 }
 
 EvolSystemCombo::~EvolSystemCombo() {
   verbize(-5, "debug", "killing of combo: %ld\n", this);
+  if (flat)
+    aifree(flat);
   // debugy code (to make sure there aren't renegate references
   above = NULL;
   below = NULL;
@@ -483,8 +1029,9 @@ EvolSystemCombo::~EvolSystemCombo() {
 void EvolSystemCombo::mutate() {
   verbize(-6, "debug", "Mutating combo %ld [%ld, %ld]\n", this,
 	  above.GetSystem(), below.GetSystem());
-  above->mutate();
-  below->mutate();
+  Flatten();
+  for (unsigned at = leafcount; at-- > 0; )  /* top down */
+    flat[at]->mutate();
 }
 
 EvolSystemPtr EvolSystemCombo::reproduce() {
@@ -494,8 +1041,8 @@ EvolSystemPtr EvolSystemCombo::reproduce() {
   verbize(-5, "debug", "Reproducing combo (no prob) %ld [%ld, %ld]\n",
 	  this, above.GetSystem(), below.GetSystem());
 
-  if (score > 0) {
-    score--;
+  if (cell->score[cellat] > 0) {
+    cell->score[cellat]--;
     newab = above->reproduce();
     newbe = below->reproduce();
     if (newab.GetSystem() && newbe.GetSystem())
@@ -515,8 +1062,8 @@ EvolSystemPtr EvolSystemCombo::reproduce(float prob) {
   verbize(-5, "debug", "Reproducing combo %ld [%ld, %ld]\n",
 	  this, above.GetSystem(), below.GetSystem());
 
-  if (score > 0) {
-    score--;
+  if (cell->score[cellat] > 0) {
+    cell->score[cellat]--;
     newab = above->reproduce(prob);
     newbe = below->reproduce(prob);
     if (newab.GetSystem() && newbe.GetSystem())
@@ -537,29 +1084,30 @@ char EvolSystemCombo::execute(char input) {
 }
 
 void EvolSystemCombo::PredFailure() {
-  above->PredFailure();
-  below->PredFailure();
-  if (predictions < ULONG_MAX)
-    predictions++;
-  age++;
-  agetotal++;
+  Flatten();
+  for (unsigned at = 0; at < flatcount; at++)
+    flat[at]->Tally(FALSE);
 }
 
 void EvolSystemCombo::PredSuccess() {
-  if (predictions < ULONG_MAX) {
-    score++;
-    predictions++;
-  }
-  above->PredSuccess();
-  below->PredSuccess();
-  age++;
-  agetotal++;
+  Flatten();
+  for (unsigned at = 0; at < flatcount; at++)
+    flat[at]->Tally(TRUE);
 }
 
 EvolSystemPtr EvolSystemCombo::CheckLife() {
   verbize(-7, "debug", "Beginning CheckLife-combo %ld (%ld:%d, %ld:%d)\n",
 	  this, above.GetSystem(), above->type, below.GetSystem(), below->type);
 
+  unsigned at;
+
+  Flatten();
+  for (at = 0; at < leafcount; at++)
+    if (((EvolSystemBasic *) flat[at])->Expired())
+      break;
+  if (at == leafcount)
+    return this;
+
   EvolSystemPtr newabove = above->CheckLife();
   EvolSystemPtr newbelow = below->CheckLife();
   EvolSystemPtr newcombo;
@@ -584,14 +1132,76 @@ EvolSystemPtr EvolSystemCombo::GetBelow() {
   return below;
 }
 
+/* Up the tower from the bottom genome, in one pass */
 char EvolSystemCombo::upexec(char input) {
   verbize(-7, "debug", "Upexec on combo %ld\n", this);
-  return above->upexec(below->upexec(input));
+  Flatten();
+  for (unsigned at = 0; at < leafcount; at++)
+    input = ((EvolSystemBasic *) flat[at])->EvolSystemBasic::dnexec(input);
+  return input;
 }
 
 char EvolSystemCombo::dnexec(char input) {
   verbize(-7, "debug", "Dnexec on combo %ld\n", this);
-  return below->dnexec(above->dnexec(input));
+  Flatten();
+  for (unsigned at = leafcount; at-- > 0; )
+    input = ((EvolSystemBasic *) flat[at])->EvolSystemBasic::dnexec(input);
+  return input;
+}
+
+/* Appends to an array of systems, doubling its room as needed */
+static EvolSystem **PushSystem(EvolSystem **systems, unsigned &count,
+			       unsigned &room, EvolSystem *sys) {
+  if (count == room) {
+    room = room ? 2 * room : 8;
+    systems = (EvolSystem **) airealloc(systems, room * sizeof(EvolSystem *),
+					"flattening a tower", 1, -3);
+  }
+  systems[count++] = sys;
+  return systems;
+}
+
+/* Lays the tower out the first time it's needed; the tree under a combo
+   never changes, and holds the references, so plain pointers do */
+void EvolSystemCombo::Flatten() {
+  EvolSystem **leaves = NULL, **combos = NULL, **stack = NULL;
+  unsigned leafroom = 0, combocount = 0, comboroom = 0;
+  unsigned depth = 0, stackroom = 0, count = 0;
+  EvolSystem *node;
+
+  if (flat)
+    return;
+  if (aithreaded)
+    pthread_mutex_lock(&flatlock);
+  if (flat) {  /* laid out while we waited */
+    pthread_mutex_unlock(&flatlock);
+    return;
+  }
+
+  /* Below before above at every level gives the upexec order */
+  stack = PushSystem(stack, depth, stackroom, this);
+  while (depth) {
+    node = stack[--depth];
+    if (node->type == CEvolSystemCombo) {
+      EvolSystemCombo *combo = (EvolSystemCombo *) node;
+
+      combos = PushSystem(combos, combocount, comboroom, node);
+      stack = PushSystem(stack, depth, stackroom, combo->above.GetSystem());
+      stack = PushSystem(stack, depth, stackroom, combo->below.GetSystem());
+    } else
+      leaves = PushSystem(leaves, count, leafroom, node);
+  }
+  leafcount = count;
+  for (unsigned at = 0; at < combocount; at++)
+    leaves = PushSystem(leaves, count, leafroom, combos[at]);
+  flatcount = count;
+  aifree(stack);
+  aifree(combos);
+
+  __sync_synchronize();  /* counts before the array they describe */
+  flat = leaves;
+  if (aithreaded)
+    pthread_mutex_unlock(&flatlock);
 }
 
 int EvolSystemCombo::AssertValid() {
@@ -617,7 +1227,8 @@ int EvolSystemCombo::WriteObject(FILE *fp) {
 }
 
 unsigned EvolSystemCombo::GetTotalSysCount() {
-  return above->GetTotalSysCount() + below->GetTotalSysCount();
+  Flatten();
+  return leafcount;
 }
 
 /***************************************************************************/
@@ -638,29 +1249,48 @@ EvolSystemPtr::EvolSystemPtr(EvolSystem *sys) {
     system->AddReference();
 }
 
-EvolSystemPtr EvolSystemPtr::operator=(const EvolSystemPtr &right) {
-  if (system)
-    system->RemoveReference();
+#if __cplusplus >= 201103L
+EvolSystemPtr::EvolSystemPtr(EvolSystemPtr &&right) {
   system = right.system;
-  if (system)
-    system->AddReference();
-  return *this;
+  right.system = NULL;
 }
+#endif
+
+/* The new reference is added first, in case it's the same system */
+EvolSystemPtr &EvolSystemPtr::operator=(const EvolSystemPtr &right) {
+  return *this = right.system;
+}
+
+EvolSystemPtr &EvolSystemPtr::operator=(EvolSystem *sys) {
+  EvolSystem *old = system;
 
-EvolSystemPtr EvolSystemPtr::operator=(EvolSystem *sys) {
-  if (system)
-    system->RemoveReference();
   system = sys;
   if (system)
     system->AddReference();
+  if (old)
+    old->RemoveReference();
   return *this;
 }
 
+#if __cplusplus >= 201103L
+EvolSystemPtr &EvolSystemPtr::operator=(EvolSystemPtr &&right) {
+  Swap(right);
+  return *this;
+}
+#endif
+
 EvolSystemPtr::~EvolSystemPtr() {
   if (system)
     system->RemoveReference();
 }
 
+void EvolSystemPtr::Swap(EvolSystemPtr &other) {
+  EvolSystem *held = system;
+
+  system = other.system;
+  other.system = held;
+}
+
 EvolSystem *EvolSystemPtr::operator->() {
   return system;
 }
@@ -683,12 +1313,8 @@ EvolSystemBasicPtr::EvolSystemBasicPtr(EvolSystemBasic *sys) {
     system->AddReference();
 }
 
-EvolSystemBasicPtr EvolSystemBasicPtr::operator=(EvolSystemBasic *sys) {
-  if (system)
-    system->RemoveReference();
-  system = sys;
-  if (system)
-    system->AddReference();
+EvolSystemBasicPtr &EvolSystemBasicPtr::operator=(EvolSystemBasic *sys) {
+  EvolSystemPtr::operator=(sys);
   return *this;
 }
 
@@ -710,12 +1336,8 @@ EvolSystemComboPtr::EvolSystemComboPtr(EvolSystemCombo *sys) {
     system->AddReference();
 }
 
-EvolSystemComboPtr EvolSystemComboPtr::operator=(EvolSystemCombo *sys) {
-  if (system)
-    system->RemoveReference();
-  system = sys;
-  if (system)
-    system->AddReference();
+EvolSystemComboPtr &EvolSystemComboPtr::operator=(EvolSystemCombo *sys) {
+  EvolSystemPtr::operator=(sys);
   return *this;
 }
 
@@ -7,14 +7,27 @@ class EvolSystemCombo;
 class EvolSystemPtr;
 class EvolSystemBasicPtr;
 class EvolSystemComboPtr;
+class GenomeCode;
+struct PopulationChunk;
 
 typedef float Confidence;
 
 #define INIT_CRED .5
 #define SYSTEM_MAX_LIFE 65536
 #define MAX_PER_CHAR 100   /* Max instructions executed for 1 prediction */
+#define BATCH_LANES 8      /* genomes ExecuteBatch steps side by side */
+
+#define DNA_INLINE 32        /* genomes this short live inside their system */
+#define DNA_POOL_MIN 64      /* smallest pooled genome buffer; classes double */
+#define DNA_POOL_CLASSES 8
+#define DNA_POOL_KEEP 256    /* spare buffers each thread keeps per class */
+
+#ifndef REFCOUNT_VERBIZE
+#define REFCOUNT_VERBIZE 0  /* debug builds may log every count change */
+#endif
 
 // Pointer classes -- used to keep track of number of references
+// (not virtual, so a pointer is just the system it holds)
 
 class EvolSystemPtr {
 public:
@@ -22,16 +35,25 @@ public:
   EvolSystemPtr();
   EvolSystemPtr(const EvolSystemPtr &right);
   EvolSystemPtr(EvolSystem *sys);
+#if __cplusplus >= 201103L
+  EvolSystemPtr(EvolSystemPtr &&right);  // takes right's reference
+#endif
 
   // Copying after construction
-  virtual EvolSystemPtr operator=(const EvolSystemPtr &right);
-  virtual EvolSystemPtr operator=(EvolSystem *sys);
+  EvolSystemPtr &operator=(const EvolSystemPtr &right);
+  EvolSystemPtr &operator=(EvolSystem *sys);
+#if __cplusplus >= 201103L
+  EvolSystemPtr &operator=(EvolSystemPtr &&right);
+#endif
 
-  virtual ~EvolSystemPtr();
+  ~EvolSystemPtr();
+
+  /* Trade systems without touching either count */
+  void Swap(EvolSystemPtr &other);
 
   EvolSystem *operator->();
-  virtual EvolSystem *GetSystem() const;
-  virtual EvolSystem **GetSystemPP();
+  EvolSystem *GetSystem() const;
+  EvolSystem **GetSystemPP();
 
 protected:
   EvolSystem *system;
@@ -44,7 +66,7 @@ public:
   EvolSystemBasicPtr(EvolSystemBasic *sys);
 
   // Copying after construction
-  virtual EvolSystemBasicPtr operator=(EvolSystemBasic *sys);
+  EvolSystemBasicPtr &operator=(EvolSystemBasic *sys);
 
   EvolSystemBasic *operator->();
   EvolSystemBasic *GetSystemBasic() const;
@@ -57,7 +79,7 @@ public:
   EvolSystemComboPtr(EvolSystemCombo *sys);
 
   // Copying after construction
-  virtual EvolSystemComboPtr operator=(EvolSystemCombo *sys);
+  EvolSystemComboPtr &operator=(EvolSystemCombo *sys);
 
   EvolSystemCombo *operator->();
   EvolSystemCombo *GetSystemCombo() const;
@@ -67,6 +89,15 @@ public:
 
 #include "base.h"
 
+/* What kin reading the same dna hold in common, under dnalock; whoever
+   drops the last reference frees it, along with its ops and native */
+struct DnaShare {
+  unsigned refs;
+  unsigned char *ops;  /* decoded by the first of them to run */
+  unsigned opsroom;
+  GenomeCode *native;  /* compiled by the first of them to get hot */
+};
+
 /* General System class (tower or individual) */
 class EvolSystem : public AIObject {
 public:
@@ -97,25 +128,27 @@ public:
 
   void AddReference();
   void RemoveReference();
+  void Tally(int success);
+  int Culled() const;  /* evicted by SystemPopulation::Cull */
 
   virtual int WriteObject(FILE *fp);
 
   virtual unsigned GetTotalSysCount() = NULL;
 
+  /* Each system's prediction for the same input, as from execute; no
+     system may be given twice */
+  static void ExecuteBatch(EvolSystem **systems, unsigned count, char input,
+			   char *predictions);
   static double GetAverageAge();
 
 protected:
-  unsigned long score;
-  unsigned long predictions;
-  unsigned long totalinst;
-  unsigned long age;
-
-  float credfact;
+  /* score, predictions, totalinst, age and credfact live in the
+     population store, at cell's cellat */
+  PopulationChunk *cell;
+  unsigned slot;
+  unsigned cellat;
 
   unsigned refcount;
-
-  static unsigned long systotal;  // not saved, but inferable
-  static unsigned long agetotal;  // not saved! just for testing purposes
 };
 
 /* single evolai system */
@@ -145,18 +178,57 @@ public:
 
   virtual unsigned GetTotalSysCount();
 
+  int Expired() const;
+  /* Where dnexec left off, so testjit can compare its two ways of running */
+  void GetRegisters(long *dnaloc, long *datloc, char *sideloc) const;
+
+  /* Decodes it if need be; genomes that write can't share lanes */
+  int Batchable();
+  /* A dnexec of each genome, in lanes stepped together */
+  static void StepLanes(EvolSystemBasic **genomes, unsigned count,
+			unsigned char *accus);
+
+  static int jit;  /* compile hot genomes to native code */
+  static int lockstep;  /* ExecuteBatch steps genomes in lanes */
+
 protected:
   EvolSystemBasic(unsigned char *newdna, unsigned newlen);
   EvolSystemBasic(EvolSystemBasicPtr prist);
 
 private:
+  void InitOps();
+  void DecodeOps();
+  void DecodeByte(long at);
+  void CompileNative();
+  void DropNative();
+  void ShareDna(EvolSystemBasic *from);
+  void OwnDna(unsigned newlen);
+  void OwnOps();
+  void PlaceDna(unsigned newlen, int shared);
+  void GrowPool(unsigned need);
+
   EvolSystemBasicPtr pristine;
 
-  unsigned char *dna;
+  unsigned char *dna;   /* may be shared with kin until either writes */
+  DnaShare *dnashare;   /* kin sharing dna, or NULL if only this */
   unsigned char *pool;
   unsigned length;
   unsigned dnalen;
   unsigned poolsize;
+  unsigned dnaroom;     /* what dna can hold before it moves */
+  unsigned char dnabuff[DNA_INLINE];  /* dna, while it fits */
+
+  unsigned char *ops;  /* the two opcodes of each byte of dna, then pool;
+			  dnashare's while they match */
+  unsigned opsroom;
+  char opsvalid;  /* FALSE once dna changes outside of dnexec */
+
+  unsigned long dnahash;  /* for the prediction cache, when hashvalid */
+  char hashvalid;
+
+  GenomeCode *native;  /* not saved; dnashare's while they match */
+  unsigned long runs;
+  char nativeoff;  /* set once the genome writes to itself */
 
   long dnal;
   long datl;
@@ -194,8 +266,14 @@ public:
   virtual unsigned GetTotalSysCount();
 
 private:
+  void Flatten();
+
   EvolSystemPtr above;
   EvolSystemPtr below;
+
+  EvolSystem **flat;  /* its genomes in upexec order, then its combos */
+  unsigned flatcount;
+  unsigned leafcount;
 };
 
 #endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "base.h"
+#include "system.h"
+#include "population.h"
+#include "jit.h"
+#include "memo.h"
+
+/* Differential test of native genomes: runs random genomes through
+   dnexec twice, one copy interpreted and one with jit on, and checks
+   that every call leaves both the same.  Half the genomes never write,
+   so they are compiled once hot; the rest drop back to the interpreter
+   at their first write.  Once hot, each breeds a child that shares its
+   dna, decoded opcodes and native code, and the children are run
+   alongside.  Each parent is then mutated.  Exits nonzero on any
+   difference.
+
+   Usage: testjit [<genomes>] [<seed>] */
+
+#define TEST_GENOMES 1000
+#define TEST_CALLS (2 * JIT_THRESHOLD)  /* calls on each genome */
+#define TEST_BREED (JIT_THRESHOLD + 1)  /* once hot, breed it here */
+#define TEST_MUTATE (3 * JIT_THRESHOLD / 2)  /* once hot, mutate it here */
+#define TEST_MAXLEN 64
+
+/* For the counters dnexec leaves in the population store */
+class TestSystem : public EvolSystemBasic {
+public:
+  TestSystem(unsigned char *newdna, unsigned newlen) :
+    EvolSystemBasic(newdna, newlen) {}
+
+  unsigned long GetTotalInst() { return cell->totalinst[cellat]; }
+  unsigned long GetPredictions() { return cell->predictions[cellat]; }
+  unsigned long GetScore() { return cell->score[cellat]; }
+};
+
+/* endc never leaves dnexec; it decides the predictions and score */
+int Compare(TestSystem *interp, TestSystem *native, char accu1, char accu2,
+	    unsigned g, unsigned call) {
+  long dnal1, datl1, dnal2, datl2;
+  char side1, side2;
+
+  interp->GetRegisters(&dnal1, &datl1, &side1);
+  native->GetRegisters(&dnal2, &datl2, &side2);
+  if (accu1 == accu2 && dnal1 == dnal2 && datl1 == datl2 && side1 == side2 &&
+      interp->GetTotalInst() == native->GetTotalInst() &&
+      interp->GetPredictions() == native->GetPredictions() &&
+      interp->GetScore() == native->GetScore())
+    return TRUE;
+
+  printf("Genome %d, call %d: accu %d/%d, dnal %ld/%ld, datl %ld/%ld, "
+	 "side %d/%d, totalinst %ld/%ld, predictions %ld/%ld, "
+	 "score %ld/%ld\n", g, call, accu1, accu2, dnal1, dnal2, datl1, datl2,
+	 side1, side2, interp->GetTotalInst(), native->GetTotalInst(),
+	 interp->GetPredictions(), native->GetPredictions(),
+	 interp->GetScore(), native->GetScore());
+  return FALSE;
+}
+
+/* Children keep no counters of their own worth comparing */
+int CompareKin(EvolSystemBasic *interp, EvolSystemBasic *native, char accu1,
+	       char accu2, unsigned g, unsigned call) {
+  long dnal1, datl1, dnal2, datl2;
+  char side1, side2;
+
+  interp->GetRegisters(&dnal1, &datl1, &side1);
+  native->GetRegisters(&dnal2, &datl2, &side2);
+  if (accu1 == accu2 && dnal1 == dnal2 && datl1 == datl2 && side1 == side2)
+    return TRUE;
+
+  printf("Child of genome %d, call %d: accu %d/%d, dnal %ld/%ld, "
+	 "datl %ld/%ld, side %d/%d\n", g, call, accu1, accu2, dnal1, dnal2,
+	 datl1, datl2, side1, side2);
+  return FALSE;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned genomes = argc > 1 ? atoi(argv[1]) : TEST_GENOMES;
+  unsigned failures = 0;
+  unsigned char dna[TEST_MAXLEN];
+
+  srand(argc > 2 ? atoi(argv[2]) : 1);
+  TrackLink::MemInitialize();
+  PredictionCache::enabled = FALSE;  /* every call must really run */
+
+  for (unsigned g = 0; g < genomes; g++) {
+    unsigned len = 1 + rand() % TEST_MAXLEN;
+
+    for (unsigned at = 0; at < len; at++) {
+      dna[at] = rand() % 256;
+      if (g % 2) {  /* no writes: op_write is opcode 2 */
+	if ((dna[at] & 15) == 2)
+	  dna[at] ^= 1;
+	if ((dna[at] >> 4) == 2)
+	  dna[at] ^= 16;
+      }
+    }
+
+    TestSystem *interp = new TestSystem(dna, len);
+    TestSystem *native = new TestSystem(dna, len);
+    EvolSystemPtr hold1 = interp, hold2 = native;
+    EvolSystemPtr kid1, kid2;
+
+    for (unsigned call = 0; call < TEST_CALLS; call++) {
+      char input = rand() % 256;
+      char accu1, accu2;
+
+      if (call == TEST_BREED) {
+	kid1 = interp->reproduce();
+	kid2 = native->reproduce();
+      }
+      if (call == TEST_MUTATE) {  /* drops the native code */
+	unsigned seed = rand();
+
+	srand(seed);
+	interp->mutate();
+	srand(seed);
+	native->mutate();
+      }
+
+      EvolSystemBasic::jit = FALSE;
+      accu1 = interp->dnexec(input);
+      EvolSystemBasic::jit = TRUE;
+      accu2 = native->dnexec(input);
+
+      if (!Compare(interp, native, accu1, accu2, g, call)) {
+	failures++;
+	break;
+      }
+
+      if (kid1.GetSystem()) {
+	EvolSystemBasic::jit = FALSE;
+	accu1 = kid1->dnexec(input);
+	EvolSystemBasic::jit = TRUE;
+	accu2 = kid2->dnexec(input);
+	if (!CompareKin((EvolSystemBasic *) kid1.GetSystem(),
+			(EvolSystemBasic *) kid2.GetSystem(), accu1, accu2, g,
+			call)) {
+	  failures++;
+	  break;
+	}
+      }
+    }
+  }
+
+  printf("%d genomes, %ld compiled: %d differ\n", genomes,
+	 GenomeCode::compiled, failures);
+  return failures ? 1 : 0;
+}
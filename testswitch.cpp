@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "base.h"
+#include "workspace.h"
+#include "reclaim.h"
+
+/* Stress test of element locks: threads switch random pairs of elements
+   with DataSwitch while others add bonds through the element and commit
+   it, or steal a copy and commit that back, as ParallelCoderack workers
+   do.  Then every reference must still find the element that names it,
+   no location may be named twice, and no element lock may be left held.
+   A lock left held stalls the other threads, so an alarm ends the run
+   instead.  Exits nonzero on any failure.
+
+   Usage: testswitch [<threads>] [<rounds per thread>] */
+
+#define TEST_ELEMENTS 1000
+#define TEST_THREADS 4
+#define TEST_ROUNDS 200000
+#define TEST_BONDS 8  /* most bonds an element is given */
+#define TEST_SECONDS 60  /* a normal run takes a few seconds */
+
+MemoryWorkspace *ws;
+WorkspaceRef **refs;
+unsigned long rounds = TEST_ROUNDS;
+unsigned long switches = 0, commits = 0, stolen = 0;
+
+void Bond(WorkspaceElt &elt, WorkspaceRef &to) {
+  if (elt.GetBondCount() < TEST_BONDS)
+    elt.AddBond(to, .5, DataBond);
+  else
+    elt.WeakenBond(elt.SelectWeightBond(), .5);
+}
+
+void *Stress(void *arg) {
+  unsigned seed = (unsigned long) arg;
+
+  for (unsigned long i = 0; i < rounds; i++) {
+    WorkspaceRef &here = *refs[rand_r(&seed) % TEST_ELEMENTS];
+    WorkspaceRef &there = *refs[rand_r(&seed) % TEST_ELEMENTS];
+
+    EpochReclaimer::Enter();
+    switch (rand_r(&seed) % 3) {
+    case 0:
+      if (&here != &there) {
+	ws->DataSwitch(here, there);
+	__sync_fetch_and_add(&switches, 1);
+      }
+      break;
+    case 1: {
+      WorkspaceElt &elt = here.GetElement();
+
+      Bond(elt, there);
+      elt.Commit();
+      __sync_fetch_and_add(&commits, 1);
+      break;
+    }
+    case 2: {
+      WorkspaceElt *copy = here.StealElement();
+
+      Bond(*copy, there);
+      copy->CommitStolen();
+      __sync_fetch_and_add(&stolen, 1);
+      break;
+    }
+    }
+    EpochReclaimer::Leave();
+  }
+
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned threads = argc > 1 ? atoi(argv[1]) : TEST_THREADS;
+  pthread_t *workers;
+  char *seen;
+  int failed = 0;
+
+  if (argc > 2)
+    rounds = atol(argv[2]);
+
+  TrackLink::MemInitialize();
+  ws = new MemoryWorkspace(TEST_ELEMENTS, NULL, NULL, 1, 65536);
+  refs = (WorkspaceRef **) aialloc(TEST_ELEMENTS * sizeof(WorkspaceRef *),
+				   "test references", 1, -1);
+  for (unsigned i = 0; i < TEST_ELEMENTS; i++) {
+    WorkspaceElt elt((Value) (i % 256));
+
+    refs[i] = &ws->AddElement(elt);
+  }
+
+  aithreaded = TRUE;
+  alarm(TEST_SECONDS);
+  workers = (pthread_t *) aialloc(threads * sizeof(pthread_t),
+				  "test threads", 1, -1);
+  for (unsigned t = 0; t < threads; t++)
+    pthread_create(&workers[t], NULL, Stress, (void *) (unsigned long) (t + 1));
+  for (unsigned t = 0; t < threads; t++)
+    pthread_join(workers[t], NULL);
+  alarm(0);
+
+  seen = (char *) aialloc(TEST_ELEMENTS, "test locations", 1, -1);
+  memset(seen, 0, TEST_ELEMENTS);
+  for (unsigned i = 0; i < TEST_ELEMENTS; i++) {
+    CNIndex loc = refs[i]->GetLocation();
+
+    if (refs[i]->GetWorkspace() != ws || loc >= TEST_ELEMENTS) {
+      printf("Reference %d left the workspace\n", i);
+      failed = 1;
+      continue;
+    }
+    if (seen[loc]) {
+      printf("Location %ld is named twice\n", loc);
+      failed = 1;
+    }
+    seen[loc] = TRUE;
+    if (&ws->GetElement(loc)->GetReference() != refs[i]) {
+      printf("Reference %d finds an element that names another\n", i);
+      failed = 1;
+    }
+  }
+  aifree(seen);
+
+  for (unsigned s = 0; s < WS_LOCK_STRIPES; s++)
+    if (pthread_mutex_trylock(ws->ElementLock(s))) {
+      printf("Element lock %d was left held\n", s);
+      failed = 1;
+    } else
+      pthread_mutex_unlock(ws->ElementLock(s));
+
+  printf("%d threads: %ld switches, %ld commits, %ld stolen commits; %s\n",
+	 threads, switches, commits, stolen, failed ? "FAILED" : "ok");
+
+  aithreaded = FALSE;
+  EpochReclaimer::Drain();
+  aifree(workers);
+  aifree(refs);
+  delete ws;
+  TrackLink::MemDestroy();
+  return failed ? 1 : 0;
+}
@@ -13,11 +13,17 @@ TextShowWorkspace::TextShowWorkspace(FILE *fp, Workspace &ws) :
 }
 
 void TextShowWorkspace::Execute() {
-  /* Randomly select an element */
-  WorkspaceRef &ref = workspace.SalientElement(irand(workspace.GetCurrentIndex()));
+  /* Select an element, favouring the hot ones */
+  if (workspace.GetCurrentIndex()) {
+    WorkspaceRef &ref =
+      workspace.GetElement(workspace.HotElement())->GetReference();
 
-  /* Put codelet to describe element into coderack */
-  workspace.GetCoderack().AddCodelet(new TextShowElement(ref));
+    /* Put codelet to describe element into coderack */
+    workspace.GetCoderack().AddCodelet(new TextShowElement(ref));
+  }
+
+  /* and stay around to pick the next one */
+  Rearm(TEXTWRK_URGE);
 }
 
 const char *TextShowWorkspace::Class() const {
@@ -78,9 +84,9 @@ void TextShowElement::Execute() {
       buff1[i+1] = bondrep[elt.GetBondCount() - 1];
     sprintf(buff2 + i, "%2d", elt.QueueSystemCount());
 
-    WorkspaceBond *next = elt.SelectRandomBond();
-    if (next)
-      curr = &next->To();
+    int next = elt.SelectRandomBond();
+    if (next != NO_BOND)
+      curr = &elt.GetBond(next).To();
     else
       break;
   }
@@ -90,9 +96,6 @@ void TextShowElement::Execute() {
 
   verbize(-1, "diagi", "%s\n", buff1);
   verbize(-1, "diagi", "%s\n", buff2);
-
-  /* Put back into coderack */
-  chosen.GetWorkspace()->GetCoderack().AddCodelet(new TextShowWorkspace(*chosen.GetWorkspace()));
 }
 
 const char *TextShowElement::Class() const {
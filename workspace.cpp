@@ -1,4 +1,11 @@
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "workspace.h"
+#include "reclaim.h"
 
 /* :: Helper Type Functions :: */
 
@@ -22,19 +29,25 @@ bool_t xdr_value(XDR *xdrs, Value *val) {
 
 /* :: Workspace Functions :: */
 
-Workspace::Workspace(CNIndex maxid, Workspace *lower, Workspace *higher,
+Workspace::Workspace(CNIndex maxid, Workspace *higher, Workspace *lower,
 		     unsigned prity, unsigned maxsz) :
   AIObject(CWorkspace) {
   lowerws = lower;
   higherws = higher;
   currindex = 0;
+  evictions = 0;
+  promotions = demotions = accesses = 0;
+  budget = 1;
 
   aiassert(maxid > 0, "creating workspace");
 
   maxindex = maxid;
   priority = prity;
 
-  theCoderack = new Coderack(maxsz);
+  theCoderack = Coderack::Create(maxsz);
+  InitStripes();
+  InitValueIndex();
+  InitHeatRank();
 
   TrackLink::MemStore(trackid, &higherws, FALSE);
   TrackLink::MemStore(trackid, &lowerws, FALSE);
@@ -50,7 +63,15 @@ Workspace::Workspace(FILE *fp) :
   fread(&lowerws, sizeof(Workspace *), 1, fp);
   fread(&maxindex, sizeof(CNIndex), 1, fp);
   fread(&priority, sizeof(unsigned), 1, fp);
+  fread(&budget, sizeof(unsigned), 1, fp);
   fread(&theCoderack, sizeof(Coderack *), 1, fp);
+  evictions = 0;
+  promotions = demotions = accesses = 0;
+  InitStripes();
+  InitValueIndex();
+  InitHeatRank();
+  valstale = TRUE;  /* the elements aren't read yet */
+  hotstale = TRUE;
 
   TrackLink::MemStore(trackid, &higherws, FALSE);
   TrackLink::MemStore(trackid, &lowerws, FALSE);
@@ -59,13 +80,34 @@ Workspace::Workspace(FILE *fp) :
 
 Workspace::~Workspace() {
   delete theCoderack;
+  for (unsigned i = 0; i < WS_LOCK_STRIPES; i++)
+    pthread_mutex_destroy(&stripes[i]);
+  for (unsigned v = 0; v < VALUE_BUCKETS; v++)
+    if (valpos[v])
+      aifree(valpos[v]);
+  if (valslot) {
+    aifree(valslot);
+    aifree(posval);
+  }
+  pthread_mutex_destroy(&vallock);
+  if (hotheap) {
+    aifree(hotheap);
+    aifree(hotkey);
+    aifree(hotpos);
+  }
+  pthread_mutex_destroy(&hotlock);
 }
 
-/* Add with random salience rank */
+/* Add with random salience rank.  At the ceiling, a level with another
+   below it adds elt there and swaps it up for one of its own cold
+   elements, which stays demoted. */
 WorkspaceRef &Workspace::AddElement(WorkspaceElt &elt) {
   if (currindex == maxindex) {
-    CNIndex replace = irand(maxindex);
-    return DataShift(replace, lowerws, elt);
+    if (!lowerws)  /* nowhere to shift to: forget one */
+      return ReplaceElement(EvictionVictim(), elt);
+    WorkspaceRef &added(lowerws->AddElement(elt));
+    demotions++;
+    return DataSwitch(GetElement(ColdElement())->GetReference(), added);
   } else {
     WorkspaceRef &tmp(RoomAddElement(elt));
     currindex++;
@@ -75,8 +117,11 @@ WorkspaceRef &Workspace::AddElement(WorkspaceElt &elt) {
 
 WorkspaceRef &Workspace::AddElement(WorkspaceRef &ref) {
   if (currindex == maxindex) {
-    CNIndex replace = irand(maxindex);
-    return DataShift(replace, lowerws, ref);
+    if (!lowerws)
+      return ReplaceElement(EvictionVictim(), ref);
+    WorkspaceRef &added(lowerws->AddElement(ref));
+    demotions++;
+    return DataSwitch(GetElement(ColdElement())->GetReference(), added);
   } else {
     WorkspaceRef &tmp(RoomAddElement(ref));
     currindex++;
@@ -93,6 +138,365 @@ void Workspace::SalientSwitch(CNIndex id, WorkspaceRef &ref, CNIndex oldid,
   oldws->SetSalient(oldid, old);
 }
 
+/* Promotion and demotion are the same swap, counted by direction */
+WorkspaceRef &Workspace::Admit(WorkspaceRef &ref) {
+  Workspace *from = ref.GetWorkspace();
+
+  if (priority > from->GetPriority()) {
+    from->promotions++;
+    demotions++;
+  } else {
+    from->demotions++;
+    promotions++;
+  }
+  return DataSwitch(GetElement(ColdElement())->GetReference(), ref);
+}
+
+CNIndex Workspace::EvictionVictim() {
+  evictions++;
+  return ColdElement();
+}
+
+/* The coldest of a few leaves of the heat heap, passing over elements
+   with systems queued on them when it can */
+CNIndex Workspace::ColdElement() {
+  CNIndex samples[EVICT_SAMPLES], leaves;
+  double keys[EVICT_SAMPLES];
+  unsigned queued, otherqueued, victim = 0;
+
+  if (aithreaded)
+    pthread_mutex_lock(&hotlock);
+  if (hotstale)
+    RebuildHeatRank();
+  RankTouched();
+  leaves = hotcount - hotcount / 2;
+  for (unsigned i = 0; i < EVICT_SAMPLES; i++)
+    if (leaves) {
+      CNIndex h = hotcount / 2 + irand(leaves);
+      samples[i] = hotheap[h];
+      keys[i] = hotkey[h];
+    } else {
+      samples[i] = irand(currindex);
+      keys[i] = 0.;
+    }
+  /* a touch can miss the log; don't evict on a heat it has outgrown */
+  for (unsigned i = 0; leaves && i < EVICT_SAMPLES; i++)
+    if (GetElement(samples[i])->GetHeat() != keys[i]) {
+      keys[i] = GetElement(samples[i])->GetHeat();
+      RankElement(samples[i]);
+    }
+  if (aithreaded)
+    pthread_mutex_unlock(&hotlock);
+
+  queued = GetElement(samples[0])->QueueSystemCount();
+  for (unsigned i = 1; i < EVICT_SAMPLES; i++) {
+    otherqueued = GetElement(samples[i])->QueueSystemCount();
+    if (otherqueued < queued ||
+	(otherqueued == queued && keys[i] < keys[victim])) {
+      victim = i;
+      queued = otherqueued;
+    }
+  }
+
+  return samples[victim];
+}
+
+/* Two random picks from the bucket and the more salient of them, to keep
+   the old scan's lean toward the front.  Entries found stale are
+   reindexed and the pick retried. */
+int Workspace::SalientWithValue(Value val, CNIndex exclude, CNIndex *found) {
+  CNIndex one, two;
+
+  if (aithreaded)
+    pthread_mutex_lock(&vallock);
+  if (valstale)
+    RebuildValueIndex();
+
+  while (valcount[val]) {
+    one = valpos[val][irand(valcount[val])];
+    two = valpos[val][irand(valcount[val])];
+    if (one == exclude || (two != exclude && two < one))
+      one = two;
+    if (one == exclude) {
+      if (valcount[val] == 1)
+	break;
+      continue;
+    }
+
+    if (SalientElement(one).BorrowElement().GetValue() != val) {
+      IndexSalient(one);
+      continue;
+    }
+
+    *found = one;
+    if (aithreaded)
+      pthread_mutex_unlock(&vallock);
+    return TRUE;
+  }
+
+  if (aithreaded)
+    pthread_mutex_unlock(&vallock);
+  return FALSE;
+}
+
+void Workspace::IndexSalient(CNIndex i) {
+  Value val;
+
+  if (valstale)
+    return;  /* all will be indexed on the next lookup */
+
+  if (aithreaded)
+    pthread_mutex_lock(&vallock);
+  if (i >= valtop) {
+    CNIndex top = valtop ? 2 * valtop : WS_CHUNK;
+    if (top <= i)
+      top = i + 1;
+    valslot = (CNIndex *) airealloc(valslot, sizeof(CNIndex) * top,
+				    "salient value slots", 1, -2);
+    posval = (Value *) airealloc(posval, sizeof(Value) * top,
+				 "salient values", 1, -2);
+    for (; valtop < top; valtop++)
+      valslot[valtop] = UNINDEXED;
+  }
+  UnindexSalient(i);
+  val = SalientElement(i).BorrowElement().GetValue();
+
+  if (valcount[val] == valroom[val]) {
+    valroom[val] = valroom[val] ? 2 * valroom[val] : VALUE_ROOM;
+    valpos[val] = (CNIndex *) airealloc(valpos[val],
+					sizeof(CNIndex) * valroom[val],
+					"salient value bucket", 1, -2);
+  }
+  valslot[i] = valcount[val];
+  posval[i] = val;
+  valpos[val][valcount[val]++] = i;
+  if (aithreaded)
+    pthread_mutex_unlock(&vallock);
+}
+
+/* Fill its hole from the end of the bucket */
+void Workspace::UnindexSalient(CNIndex i) {
+  Value val;
+  CNIndex last;
+
+  if (i >= valtop || valslot[i] == UNINDEXED)
+    return;
+  val = posval[i];
+
+  last = valpos[val][--valcount[val]];
+  valpos[val][valslot[i]] = last;
+  valslot[last] = valslot[i];
+  valslot[i] = UNINDEXED;
+}
+
+void Workspace::RebuildValueIndex() {
+  valstale = FALSE;
+  for (CNIndex i = 0; i < currindex; i++)
+    IndexSalient(i);
+}
+
+/* Recursive, since a lookup reindexes through IndexSalient */
+void Workspace::InitValueIndex() {
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&vallock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  valslot = NULL;  /* grown as positions are indexed */
+  posval = NULL;
+  valtop = 0;
+  for (unsigned v = 0; v < VALUE_BUCKETS; v++) {
+    valpos[v] = NULL;
+    valcount[v] = valroom[v] = 0;
+    TrackLink::MemStore(trackid, &valpos[v], FALSE);
+  }
+  valstale = FALSE;
+
+  TrackLink::MemStore(trackid, &valslot, FALSE);
+  TrackLink::MemStore(trackid, &posval, FALSE);
+}
+
+void Workspace::RankElement(CNIndex id) {
+  WorkspaceElt *elt = GetElement(id);
+  CNIndex h;
+
+  if (!elt || hotstale)
+    return;  /* refilled by the caller, or all ranked on the next lookup */
+
+  if (aithreaded)
+    pthread_mutex_lock(&hotlock);
+  if (id >= hottop) {
+    CNIndex top = hottop ? 2 * hottop : WS_CHUNK;
+    if (top <= id)
+      top = id + 1;
+    hotheap = (CNIndex *) airealloc(hotheap, sizeof(CNIndex) * top,
+				    "heat ranks", 1, -2);
+    hotkey = (double *) airealloc(hotkey, sizeof(double) * top,
+				  "heat rank keys", 1, -2);
+    hotpos = (CNIndex *) airealloc(hotpos, sizeof(CNIndex) * top,
+				   "heat rank places", 1, -2);
+    for (; hottop < top; hottop++)
+      hotpos[hottop] = UNINDEXED;
+  }
+  h = hotpos[id];
+  if (h == UNINDEXED) {
+    h = hotcount++;
+    hotheap[h] = id;
+  }
+  hotkey[h] = elt->GetHeat();
+  SiftHot(h);
+  if (aithreaded)
+    pthread_mutex_unlock(&hotlock);
+}
+
+/* Walks the heap from the top, keeping its frontier in a small heap of
+   its own, so only about k entries are looked at */
+CNIndex Workspace::HottestElements(CNIndex *found, CNIndex k) {
+  CNIndex *front, fronts = 0, count = 0;
+
+  if (aithreaded)
+    pthread_mutex_lock(&hotlock);
+  if (hotstale)
+    RebuildHeatRank();
+  RankTouched();
+
+  front = (CNIndex *) aialloc(sizeof(CNIndex) * (k + 1),
+			      "heat rank frontier", 1, -2);
+  if (hotcount && k)
+    front[fronts++] = 0;
+  while (count < k && fronts) {
+    CNIndex top = front[0], last = front[--fronts], node, child;
+
+    found[count++] = hotheap[top];
+    for (node = 0; (child = 2 * node + 1) < fronts; node = child) {
+      if (child + 1 < fronts && hotkey[front[child + 1]] > hotkey[front[child]])
+	child++;
+      if (hotkey[front[child]] <= hotkey[last])
+	break;
+      front[node] = front[child];
+    }
+    front[node] = last;
+
+    for (child = 2 * top + 1; child <= 2 * top + 2 && child < hotcount;
+	 child++) {
+      for (node = fronts++; node && hotkey[front[(node - 1) / 2]] <
+	     hotkey[child]; node = (node - 1) / 2)
+	front[node] = front[(node - 1) / 2];
+      front[node] = child;
+    }
+  }
+  aifree(front);
+
+  if (aithreaded)
+    pthread_mutex_unlock(&hotlock);
+  return count;
+}
+
+/* A heap place below a random bound, which leans toward the top */
+CNIndex Workspace::HotElement() {
+  CNIndex id, bound;
+
+  if (aithreaded)
+    pthread_mutex_lock(&hotlock);
+  if (hotstale)
+    RebuildHeatRank();
+  RankTouched();
+  if (hotcount) {
+    bound = irand(hotcount) + 1;
+    id = hotheap[irand(bound)];
+  } else
+    id = irand(currindex);
+  if (aithreaded)
+    pthread_mutex_unlock(&hotlock);
+
+  return id;
+}
+
+/* Up if it has outgrown its parent, otherwise down */
+void Workspace::SiftHot(CNIndex h) {
+  CNIndex id = hotheap[h], start = h, child;
+  double key = hotkey[h];
+
+  for (; h && hotkey[(h - 1) / 2] < key; h = (h - 1) / 2) {
+    hotheap[h] = hotheap[(h - 1) / 2];
+    hotkey[h] = hotkey[(h - 1) / 2];
+    hotpos[hotheap[h]] = h;
+  }
+  if (h == start)
+    for (; (child = 2 * h + 1) < hotcount; h = child) {
+      if (child + 1 < hotcount && hotkey[child + 1] > hotkey[child])
+	child++;
+      if (hotkey[child] <= key)
+	break;
+      hotheap[h] = hotheap[child];
+      hotkey[h] = hotkey[child];
+      hotpos[hotheap[h]] = h;
+    }
+  hotheap[h] = id;
+  hotkey[h] = key;
+  hotpos[id] = h;
+}
+
+void Workspace::RebuildHeatRank() {
+  hotstale = FALSE;
+  hotcount = 0;
+  for (CNIndex i = 0; i < hottop; i++)
+    hotpos[i] = UNINDEXED;
+  for (CNIndex i = 0; i < currindex; i++)
+    RankElement(i);
+}
+
+/* Holds a touched location for the next lookup, without a lock.  Its
+   slot may hold another location, and then the touch is only seen when
+   ColdElement samples the element. */
+void Workspace::LogTouch(CNIndex id) {
+  CNIndex *slot = &hotlog[id % HEAT_LOG];
+
+  if (*slot == id || hotstale)
+    return;
+  if (__sync_bool_compare_and_swap(slot, UNINDEXED, id))
+    __sync_fetch_and_add(&hotlogged, 1);
+}
+
+/* Reranks the logged touches, under hotlock */
+void Workspace::RankTouched() {
+  if (!hotlogged)
+    return;
+  __sync_lock_test_and_set(&hotlogged, 0);
+  for (unsigned s = 0; s < HEAT_LOG; s++)
+    if (hotlog[s] != UNINDEXED) {
+      CNIndex id = __sync_lock_test_and_set(&hotlog[s], UNINDEXED);
+
+      if (id != UNINDEXED)
+	RankElement(id);
+    }
+}
+
+/* Recursive, since a lookup may rebuild through RankElement */
+void Workspace::InitHeatRank() {
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&hotlock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  hotheap = NULL;  /* grown as locations are ranked */
+  hotkey = NULL;
+  hotpos = NULL;
+  hotcount = hottop = 0;
+  hotstale = FALSE;
+  for (unsigned s = 0; s < HEAT_LOG; s++)
+    hotlog[s] = UNINDEXED;
+  hotlogged = 0;
+
+  TrackLink::MemStore(trackid, &hotheap, FALSE);
+  TrackLink::MemStore(trackid, &hotkey, FALSE);
+  TrackLink::MemStore(trackid, &hotpos, FALSE);
+}
+
 Workspace *Workspace::GetHigherWorkspace() {
   return higherws;
 }
@@ -117,14 +521,90 @@ CNIndex Workspace::GetMaxIndex() {
   return maxindex;
 }
 
+unsigned long Workspace::GetEvictions() {
+  return evictions;
+}
+
+unsigned long Workspace::GetPromotions() {
+  return promotions;
+}
+
+unsigned long Workspace::GetDemotions() {
+  return demotions;
+}
+
+unsigned long Workspace::GetAccesses() {
+  return accesses;
+}
+
+/* Unlocked, like the other counters; only the status reads it */
+void Workspace::CountAccess() {
+  accesses++;
+}
+
 unsigned Workspace::GetPriority() {
   return priority;
 }
 
+unsigned Workspace::GetBudget() {
+  return budget;
+}
+
+void Workspace::SetBudget(unsigned codelets) {
+  budget = codelets ? codelets : 1;
+}
+
 Coderack &Workspace::GetCoderack() {
   return *theCoderack;
 }
 
+void Workspace::LockElement(CNIndex id) {
+  if (aithreaded)
+    pthread_mutex_lock(ElementLock(id));
+}
+
+void Workspace::UnlockElement(CNIndex id) {
+  if (aithreaded)
+    pthread_mutex_unlock(ElementLock(id));
+}
+
+pthread_mutex_t *Workspace::ElementLock(CNIndex id) {
+  return &stripes[id % WS_LOCK_STRIPES];
+}
+
+/* Lower address first, so two switches can't deadlock */
+void Workspace::LockPair(pthread_mutex_t *one, pthread_mutex_t *two) {
+  if (!aithreaded)
+    return;
+  if (one > two) {
+    pthread_mutex_t *tmp = one;
+    one = two;
+    two = tmp;
+  }
+  pthread_mutex_lock(one);
+  if (two != one)
+    pthread_mutex_lock(two);
+}
+
+void Workspace::UnlockPair(pthread_mutex_t *one, pthread_mutex_t *two) {
+  if (!aithreaded)
+    return;
+  if (two != one)
+    pthread_mutex_unlock(two);
+  pthread_mutex_unlock(one);
+}
+
+/* Recursive, since a locked commit may copy through to bond adds */
+void Workspace::InitStripes() {
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  for (unsigned i = 0; i < WS_LOCK_STRIPES; i++)
+    pthread_mutex_init(&stripes[i], &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
 int Workspace::WriteObject(FILE *fp) {
   size_t result = AIObject::WriteObject(fp);
   result = fwrite(&currindex, sizeof(CNIndex), 1, fp) + result;
@@ -132,6 +612,7 @@ int Workspace::WriteObject(FILE *fp) {
   result = fwrite(&lowerws, sizeof(Workspace *), 1, fp) + result;
   result = fwrite(&maxindex, sizeof(CNIndex), 1, fp) + result;
   result = fwrite(&priority, sizeof(unsigned), 1, fp) + result;
+  result = fwrite(&budget, sizeof(unsigned), 1, fp) + result;
   return fwrite(&theCoderack, sizeof(Coderack *), 1, fp) + result;
 }
 
@@ -148,6 +629,8 @@ static bool_t Workspace::xdr_proc(XDR *xdrs, Workspace *ws) {
     return FALSE;
   if (!xdr_u_int(xdrs, ws->priority))
     return FALSE;
+  if (!xdr_u_int(xdrs, ws->budget))
+    return FALSE;
   if (!Coderack::xdr_ptr(xdrs, ws->theCoderack))
     return FALSE;
   return TRUE;
@@ -160,14 +643,9 @@ MemoryWorkspace::MemoryWorkspace(CNIndex maxid, Workspace *higher,
 				 unsigned maxsz) :
   Workspace(maxid, higher, lower, prity, maxsz) {
   type = CMemoryWorkspace;
-  data = (WorkspaceElt **) aialloc(sizeof(WorkspaceElt *) * GetMaxIndex(),
-				   "MemoryWorkspace data array", 1, -1);
-  refs = (WorkspaceRef **) aialloc(sizeof(WorkspaceRef *) * GetMaxIndex(),
-				   "MemoryWorkspace data array", 1, -1);
-  for (CNIndex i = 0; i < GetMaxIndex(); i++) {
-    refs[i] = NULL;
-    data[i] = NULL;
-  }
+  data = NULL;
+  refs = NULL;
+  chunks = chunkroom = 0;
 
   TrackLink::MemStore(trackid, &data, FALSE);
   TrackLink::MemStore(trackid, &refs, FALSE);
@@ -177,26 +655,49 @@ MemoryWorkspace::MemoryWorkspace(FILE *fp) :
   Workspace(fp) {
   verbize(-4, "debug", "Creating MemoryWorkspace from file\n");
 
-  data = (WorkspaceElt **) aialloc(sizeof(WorkspaceElt *) * GetMaxIndex(),
-				   "MemoryWorkspace data array", 1, -1);
-  refs = (WorkspaceRef **) aialloc(sizeof(WorkspaceRef *) * GetMaxIndex(),
-				   "MemoryWorkspace data array", 1, -1);
-  fread(data, sizeof(WorkspaceElt *), GetCurrentIndex(), fp);
-  fread(refs, sizeof(WorkspaceRef *), GetCurrentIndex(), fp);
+  data = NULL;
+  refs = NULL;
+  chunks = chunkroom = 0;
+  if (GetCurrentIndex())
+    GrowChunks(GetCurrentIndex() - 1);
+  for (CNIndex i = 0; i < GetCurrentIndex(); i++) {
+    fread(&DataAt(i), sizeof(WorkspaceElt *), 1, fp);
+    TrackLink::MemStore(trackid, &DataAt(i), FALSE);
+  }
+  for (CNIndex i = 0; i < GetCurrentIndex(); i++) {
+    fread(&RefAt(i), sizeof(WorkspaceRef *), 1, fp);
+    TrackLink::MemStore(trackid, &RefAt(i), FALSE);
+  }
 
   TrackLink::MemStore(trackid, &data, FALSE);
   TrackLink::MemStore(trackid, &refs, FALSE);
 }
 
 MemoryWorkspace::~MemoryWorkspace() {
-  for (CNIndex i = 0; i < GetMaxIndex(); i++) {
-    if (refs[i])
-      delete refs[i];
-    if (data[i])
-      delete data[i];
+  for (CNIndex i = 0; i < chunks * WS_CHUNK; i++) {
+    if (RefAt(i))
+      delete RefAt(i);
+    if (DataAt(i))
+      delete DataAt(i);
+  }
+  for (CNIndex c = 0; c < chunks; c++) {
+    aifree(data[c]);
+    aifree(refs[c]);
+  }
+  if (data) {
+    aifree(data);
+    aifree(refs);
   }
-  delete[] data;
-  delete[] refs;
+}
+
+/* A rough footprint per element: the element, its two refs, its slots
+   and a first bond array */
+CNIndex MemoryWorkspace::CeilingIndex(unsigned long bytes) {
+  CNIndex fit = bytes / (sizeof(WorkspaceElt) + 2 * sizeof(WorkspaceRef) +
+			 2 * sizeof(void *) +
+			 BOND_ROOM * (sizeof(WorkspaceBond) +
+				      sizeof(BondStrength)));
+  return fit ? fit : 1;
 }
 
 /* actually move storage of data and change all references
@@ -206,12 +707,14 @@ WorkspaceRef &MemoryWorkspace::DataShift(CNIndex id, Workspace *newws,
 					  WorkspaceElt &elt) {
   /* Move data into appropriate spots, update references */
   /* AddElement(WorkspaceRef) updates references for that element */
-  newws->AddElement(data[id]->GetSalientLoc());
+  newws->AddElement(DataAt(id)->GetSalientLoc());
 
-  data[id] = &elt;
-  refs[id] = new WorkspaceRef(this, currindex);
+  DataAt(id) = &elt;
+  RefAt(id) = new WorkspaceRef(this, currindex);
+  IndexSalient(id);
+  RankElement(id);
 
-  return *refs[id];
+  return *RefAt(id);
 }
 
 /* actually move storage of data and change all references
@@ -220,75 +723,206 @@ WorkspaceRef &MemoryWorkspace::DataShift(CNIndex id, Workspace *newws,
 					  WorkspaceRef &repl) {
   /* Move data into appropriate spots, update references */
   /* AddElement(WorkspaceRef) updates references for that element */
-  newws->AddElement(data[id]->GetSalientLoc());
+  newws->AddElement(DataAt(id)->GetSalientLoc());
 
-  data[id] = repl.GetWorkspace()->GetElement(repl.GetLocation());
+  DataAt(id) = repl.GetWorkspace()->GetElement(repl.GetLocation());
   repl.lookup = this;
   repl.location = id;
+  IndexSalient(id);
+  RankElement(id);
   return repl;
 }
 
 /* "proper" data switch: put each element where the other was */
 WorkspaceRef &MemoryWorkspace::DataSwitch(WorkspaceRef &here,
 					  WorkspaceRef &repl) {
-  repl.GetWorkspace()->SetElement(repl.GetLocation(),
-				  *here.GetWorkspace()->
-				  GetElement(here.GetLocation()));
+  Workspace *herews, *replws;
+  CNIndex hereloc, replloc;
+  pthread_mutex_t *herelock, *repllock;
+
+  /* the refs move during the switch, so hold on to their old locks;
+     taken again if another switch moved either while this one waited */
+  for (;;) {
+    herews = here.GetWorkspace();
+    hereloc = here.GetLocation();
+    replws = repl.GetWorkspace();
+    replloc = repl.GetLocation();
+    herelock = herews->ElementLock(hereloc);
+    repllock = replws->ElementLock(replloc);
+    LockPair(herelock, repllock);
+    if (!aithreaded || (herews == here.GetWorkspace() &&
+			hereloc == here.GetLocation() &&
+			replws == repl.GetWorkspace() &&
+			replloc == repl.GetLocation()))
+      break;
+    UnlockPair(herelock, repllock);
+  }
+  /* exchange the element pointers; nothing is copied */
+  WorkspaceElt *displaced = repl.GetWorkspace()->
+    SwapElement(repl.GetLocation(), here.GetWorkspace()->
+		GetElement(here.GetLocation()));
   CNIndex id = here.GetLocation();
   here.lookup = repl.GetWorkspace();
   here.location = repl.GetLocation();
 
-  data[id] = repl.GetWorkspace()->GetElement(repl.GetLocation());
+  DataAt(id) = displaced;
   repl.lookup = this;
   repl.location = id;
+  IndexSalient(id);
+  RankElement(id);
+  here.GetWorkspace()->RankElement(here.GetLocation());
+  UnlockPair(herelock, repllock);
   return repl;
 }
 
 WorkspaceElt *MemoryWorkspace::GetElement(CNIndex id) {
-  return data[id];
+  return DataAt(id);
 }
 
 void MemoryWorkspace::SetElement(CNIndex id, const WorkspaceElt &elt) {
+  WorkspaceElt *old = DataAt(id);
+
   verbize(-5, "debug", "Setting Element at %ld\n", id);
-  if (data[id])
-    delete data[id];
-  verbize(-8, "debug", "Deleted old at %ld\n", id);
-  data[id] = new WorkspaceElt(elt);
+  /* readers see the old element or the new one, never a freed one */
+  DataAt(id) = new WorkspaceElt(elt);
+  EpochReclaimer::Retire(old);
+  verbize(-8, "debug", "Retired old at %ld\n", id);
+}
+
+/* Takes elt itself, so nothing is copied whatever its bond count */
+void MemoryWorkspace::SetElement(CNIndex id, WorkspaceElt *elt) {
+  WorkspaceElt *old = DataAt(id);
+
+  verbize(-5, "debug", "Setting Element at %ld uncopied\n", id);
+  DataAt(id) = elt;
+  if (old != elt)
+    EpochReclaimer::Retire(old);
+}
+
+WorkspaceElt *MemoryWorkspace::SwapElement(CNIndex id, WorkspaceElt *elt) {
+  WorkspaceElt *old = DataAt(id);
+
+  verbize(-5, "debug", "Swapping Element at %ld\n", id);
+  DataAt(id) = elt;
+  return old;
 }
 
 WorkspaceRef &MemoryWorkspace::SalientElement(CNIndex i) {
-  return *refs[i];
+  return *RefAt(i);
 }
 
 void MemoryWorkspace::SetSalient(CNIndex i, WorkspaceRef &ref) {
-  refs[i] = &ref;
+  RefAt(i) = &ref;
+  IndexSalient(i);
 }
 
 WorkspaceRef &MemoryWorkspace::RoomAddElement(WorkspaceElt &elt) {
   verbize(-4, "debug", "Adding element to ID %ld\n", currindex);
-  refs[currindex] = new WorkspaceRef(this, currindex);
-  data[currindex] = new WorkspaceElt(elt, *refs[currindex],
-				     *(new WorkspaceRef(this, currindex)));
-  TrackLink::MemStore(trackid, &data[currindex], FALSE);
-  TrackLink::MemStore(trackid, &refs[currindex], FALSE);
+  GrowChunks(currindex);
+  RefAt(currindex) = new WorkspaceRef(this, currindex);
+  DataAt(currindex) = new WorkspaceElt(elt, *RefAt(currindex),
+				       *(new WorkspaceRef(this, currindex)));
+  TrackLink::MemStore(trackid, &DataAt(currindex), FALSE);
+  TrackLink::MemStore(trackid, &RefAt(currindex), FALSE);
+  IndexSalient(currindex);
+  RankElement(currindex);
 
-  return *refs[currindex];
+  return *RefAt(currindex);
 }
 
+/* Takes the element itself out of its old slot, which the caller refills */
 WorkspaceRef &MemoryWorkspace::RoomAddElement(WorkspaceRef &ref) {
-  data[currindex] = ref.StealElement();
-  TrackLink::MemStore(trackid, &data[currindex], FALSE);
+  GrowChunks(currindex);
+  DataAt(currindex) = ref.GetWorkspace()->SwapElement(ref.GetLocation(), NULL);
+  RefAt(currindex) = &ref;
+  TrackLink::MemStore(trackid, &DataAt(currindex), FALSE);
+  TrackLink::MemStore(trackid, &RefAt(currindex), FALSE);
 
   ref.lookup = this;
   ref.location = currindex;
+  IndexSalient(currindex);
+  RankElement(currindex);
   return ref;
 }
 
+/* At the ceiling: elt takes over the slot and refs of the element at id,
+   which is forgotten */
+WorkspaceRef &MemoryWorkspace::ReplaceElement(CNIndex id, WorkspaceElt &elt) {
+  WorkspaceElt *old = DataAt(id);
+
+  verbize(-4, "memory", "Evicting element %ld\n", id);
+  LockElement(id);
+  DataAt(id) = new WorkspaceElt(elt, old->GetReference(),
+				old->GetSalientLoc());
+  UnlockElement(id);
+  EpochReclaimer::Retire(old);
+  IndexSalient(id);
+  RankElement(id);
+
+  return DataAt(id)->GetReference();
+}
+
+WorkspaceRef &MemoryWorkspace::ReplaceElement(CNIndex id, WorkspaceRef &ref) {
+  WorkspaceElt *old = DataAt(id);
+
+  verbize(-4, "memory", "Evicting element %ld\n", id);
+  LockElement(id);
+  DataAt(id) = ref.GetWorkspace()->SwapElement(ref.GetLocation(), NULL);
+  UnlockElement(id);
+  EpochReclaimer::Retire(old);
+
+  ref.lookup = this;
+  ref.location = id;
+  IndexSalient(id);
+  RankElement(id);
+  return ref;
+}
+
+/* Adds chunks until element id has a slot; the chunk table may move,
+   the chunks never do */
+void MemoryWorkspace::GrowChunks(CNIndex id) {
+  while (id >= chunks * WS_CHUNK) {
+    if (chunks == chunkroom) {
+      CNIndex room = chunkroom ? 2 * chunkroom : WS_CHUNK_ROOM;
+
+      if (data) {
+	TrackLink::MemRemoveRange(trackid, data,
+				  sizeof(WorkspaceElt **) * chunkroom);
+	TrackLink::MemRemoveRange(trackid, refs,
+				  sizeof(WorkspaceRef **) * chunkroom);
+      }
+      data = (WorkspaceElt ***) airealloc(data, sizeof(WorkspaceElt **) * room,
+					  "MemoryWorkspace chunk table", 1, -1);
+      refs = (WorkspaceRef ***) airealloc(refs, sizeof(WorkspaceRef **) * room,
+					  "MemoryWorkspace chunk table", 1, -1);
+      for (CNIndex c = 0; c < chunks; c++) {
+	TrackLink::MemStore(trackid, &data[c], FALSE);
+	TrackLink::MemStore(trackid, &refs[c], FALSE);
+      }
+      chunkroom = room;
+    }
+
+    data[chunks] = (WorkspaceElt **) aialloc(sizeof(WorkspaceElt *) * WS_CHUNK,
+					     "MemoryWorkspace data chunk",
+					     1, -1);
+    refs[chunks] = (WorkspaceRef **) aialloc(sizeof(WorkspaceRef *) * WS_CHUNK,
+					     "MemoryWorkspace data chunk",
+					     1, -1);
+    memset(data[chunks], 0, sizeof(WorkspaceElt *) * WS_CHUNK);
+    memset(refs[chunks], 0, sizeof(WorkspaceRef *) * WS_CHUNK);
+    TrackLink::MemStore(trackid, &data[chunks], FALSE);
+    TrackLink::MemStore(trackid, &refs[chunks], FALSE);
+    chunks++;
+  }
+}
+
 int MemoryWorkspace::WriteObject(FILE *fp) {
   size_t result = Workspace::WriteObject(fp);
-  result = fwrite(data, sizeof(WorkspaceElt *), GetCurrentIndex(), fp)
-    + result;
-  return fwrite(refs, sizeof(WorkspaceRef *), GetCurrentIndex(), fp) + result;
+  for (CNIndex i = 0; i < GetCurrentIndex(); i++)
+    result = fwrite(&DataAt(i), sizeof(WorkspaceElt *), 1, fp) + result;
+  for (CNIndex i = 0; i < GetCurrentIndex(); i++)
+    result = fwrite(&RefAt(i), sizeof(WorkspaceRef *), 1, fp) + result;
+  return result;
 }
 
 static bool_t MemoryWorkspace::xdr_proc(XDR *xdrs, MemoryWorkspace *ws) {
@@ -303,8 +937,285 @@ static bool_t MemoryWorkspace::xdr_proc(XDR *xdrs, MemoryWorkspace *ws) {
   return TRUE;
 }
 
+/* :: ImageWorkspace Functions :: */
+
+ImageWorkspace::ImageWorkspace(const char *file, int bigend, CNIndex maxid,
+			       Workspace *higher, Workspace *lower,
+			       unsigned prity, unsigned maxsz) :
+  MemoryWorkspace(maxid, higher, lower, prity, maxsz) {
+  path = (char *) aialloc(strlen(file) + 1, "ImageWorkspace path", 1, -1);
+  strcpy(path, file);
+  bigendian = bigend;
+  TrackLink::MemStore(trackid, &path, FALSE);
+
+  if (Load())
+    verbize(-1, "memory", "Loaded %ld elements from %s\n", currindex, path);
+}
+
+ImageWorkspace::ImageWorkspace(FILE *fp, int bigend) :
+  MemoryWorkspace(fp) {
+  unsigned len;
+
+  fread(&len, sizeof(unsigned), 1, fp);
+  path = (char *) aialloc(len + 1, "ImageWorkspace path", 1, -1);
+  fread(path, sizeof(char), len, fp);
+  path[len] = '\0';
+  bigendian = bigend;
+  TrackLink::MemStore(trackid, &path, FALSE);
+}
+
+ImageWorkspace::~ImageWorkspace() {
+  aifree(path);
+}
+
+/* Fills path.tmp through a shared mapping, then renames it over the
+   image, so a reader only ever sees a whole image */
+int ImageWorkspace::Sync() {
+  unsigned long size = WSIMG_HEADER + currindex * (WSIMG_RECORD +
+						   WSIMG_SALIENT);
+  char *tmppath = (char *) aialloc(strlen(path) + 5, "ImageWorkspace path",
+				   1, -1);
+  unsigned char *image, *at;
+  int fd;
+
+  sprintf(tmppath, "%s.tmp", path);
+  fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, size) < 0) {
+    verbize(2, "error", "Cannot write workspace image %s\n", tmppath);
+    if (fd >= 0)
+      close(fd);
+    aifree(tmppath);
+    return FALSE;
+  }
+  image = (unsigned char *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    verbize(2, "error", "Cannot map workspace image %s\n", tmppath);
+    unlink(tmppath);
+    aifree(tmppath);
+    return FALSE;
+  }
+
+  memcpy(image, "CNWS", 4);
+  PutWord(image + 4, WSIMG_VERSION, 2);
+  image[6] = bigendian ? 'B' : 'L';
+  image[7] = 0;
+  PutWord(image + 8, currindex, 8);
+  PutWord(image + 16, GetMaxIndex(), 8);
+
+  at = image + WSIMG_HEADER;
+  for (CNIndex i = 0; i < currindex; i++, at += WSIMG_RECORD) {
+    WorkspaceElt *elt = DataAt(i);
+    unsigned kept = 0;
+
+    memset(at, 0, WSIMG_RECORD);
+    if (!elt)
+      continue;
+    at[0] = elt->GetValue();
+    /* the strongest bonds within this workspace, by selection */
+    for (unsigned slot = 0; slot < elt->GetBondCount(); slot++) {
+      WorkspaceBond bond = elt->GetBond(slot);
+      BondStrength str = bond.GetStrength();
+      unsigned place, bits;
+
+      if (bond.To().GetWorkspace() != this)
+	continue;
+      for (place = kept; place > 0; place--) {
+	unsigned char *prev = at + 2 + (place - 1) * WSIMG_BOND;
+	BondStrength prevstr;
+
+	bits = GetWord(prev + 8, 4);
+	memcpy(&prevstr, &bits, sizeof(BondStrength));
+	if (prevstr >= str)
+	  break;
+	if (place < WSIMG_BONDS)
+	  memcpy(prev + WSIMG_BOND, prev, WSIMG_BOND);
+      }
+      if (place == WSIMG_BONDS)
+	continue;
+      memcpy(&bits, &str, sizeof(BondStrength));
+      PutWord(at + 2 + place * WSIMG_BOND, bond.To().GetLocation(), 8);
+      PutWord(at + 2 + place * WSIMG_BOND + 8, bits, 4);
+      at[2 + place * WSIMG_BOND + 12] = bond.GetType();
+      if (kept < WSIMG_BONDS)
+	kept++;
+    }
+    at[1] = kept;
+  }
+
+  for (CNIndex i = 0; i < currindex; i++, at += WSIMG_SALIENT)
+    if (RefAt(i) && RefAt(i)->GetWorkspace() == this)
+      PutWord(at, RefAt(i)->GetLocation(), 8);
+    else
+      PutWord(at, (unsigned long) -1, 8);
+
+  msync(image, size, MS_SYNC);
+  munmap(image, size);
+  if (rename(tmppath, path) < 0) {
+    verbize(2, "error", "Cannot replace workspace image %s\n", path);
+    unlink(tmppath);
+    aifree(tmppath);
+    return FALSE;
+  }
+  aifree(tmppath);
+  return TRUE;
+}
+
+const char *ImageWorkspace::GetPath() {
+  return path;
+}
+
+int ImageWorkspace::WriteObject(FILE *fp) {
+  size_t result = MemoryWorkspace::WriteObject(fp);
+  unsigned len = strlen(path);
+
+  result = fwrite(&len, sizeof(unsigned), 1, fp) + result;
+  result = fwrite(path, sizeof(char), len, fp) + result;
+  return result;
+}
+
+/* Adds the image's elements to an empty workspace, then their bonds,
+   then puts back their salience order if the image holds a whole one.
+   FALSE, leaving the workspace empty, if there is no usable image. */
+int ImageWorkspace::Load() {
+  struct stat info;
+  unsigned char *image, *at;
+  CNIndex count, stored;
+  WorkspaceRef **old;
+  char *seen;
+  int fd, whole = TRUE;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+  if (fstat(fd, &info) < 0 || info.st_size < WSIMG_HEADER) {
+    close(fd);
+    return FALSE;
+  }
+  image = (unsigned char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+				 fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    return FALSE;
+
+  count = stored = GetWord(image + 8, 8);
+  if (memcmp(image, "CNWS", 4) || GetWord(image + 4, 2) != WSIMG_VERSION ||
+      image[6] != (bigendian ? 'B' : 'L') ||
+      (unsigned long) info.st_size != WSIMG_HEADER +
+      stored * (WSIMG_RECORD + WSIMG_SALIENT)) {
+    verbize(2, "error", "%s is not a usable workspace image\n", path);
+    munmap(image, info.st_size);
+    return FALSE;
+  }
+  if (count > GetMaxIndex()) {
+    verbize(1, "memory", "Keeping %ld of %ld elements in %s\n",
+	    GetMaxIndex(), count, path);
+    count = GetMaxIndex();
+  }
+
+  at = image + WSIMG_HEADER;
+  for (CNIndex i = 0; i < count; i++, at += WSIMG_RECORD) {
+    WorkspaceElt elt((Value) at[0]);
+    AddElement(elt);
+  }
+
+  at = image + WSIMG_HEADER;
+  for (CNIndex i = 0; i < count; i++, at += WSIMG_RECORD)
+    for (unsigned slot = 0; slot < at[1] && slot < WSIMG_BONDS; slot++) {
+      unsigned char *bond = at + 2 + slot * WSIMG_BOND;
+      CNIndex to = GetWord(bond, 8);
+      unsigned bits = GetWord(bond + 8, 4);
+      BondStrength str;
+
+      if (to >= count)
+	continue;
+      memcpy(&str, &bits, sizeof(BondStrength));
+      DataAt(i)->AddBond(DataAt(to)->GetReference(), str,
+			 (BondType) bond[12]);
+    }
+
+  /* salient position i held the element at location loc[i]; only a
+     permutation of the kept elements can be put back */
+  at = image + WSIMG_HEADER + stored * WSIMG_RECORD;
+  seen = (char *) aialloc(count + 1, "ImageWorkspace load", 1, -1);
+  memset(seen, 0, count + 1);
+  for (CNIndex i = 0; i < count && whole; i++) {
+    CNIndex loc = GetWord(at + i * WSIMG_SALIENT, 8);
+
+    if (loc >= count || seen[loc])
+      whole = FALSE;
+    else
+      seen[loc] = TRUE;
+  }
+  aifree(seen);
+  if (whole && count) {
+    old = (WorkspaceRef **) aialloc(count * sizeof(WorkspaceRef *),
+				    "ImageWorkspace load", 1, -1);
+
+    for (CNIndex i = 0; i < count; i++)
+      old[i] = RefAt(i);
+    for (CNIndex i = 0; i < count; i++)
+      RefAt(i) = old[GetWord(at + i * WSIMG_SALIENT, 8)];
+    for (CNIndex i = 0; i < count; i++)
+      IndexSalient(i);
+    aifree(old);
+  }
+
+  munmap(image, info.st_size);
+  return TRUE;
+}
+
+/* Image fields are unsigned and sized, in the image's byte order */
+void ImageWorkspace::PutWord(unsigned char *at, unsigned long word,
+			      unsigned bytes) {
+  for (unsigned i = 0; i < bytes; i++)
+    at[bigendian ? bytes - 1 - i : i] = (word >> (8 * i)) & 0xff;
+}
+
+unsigned long ImageWorkspace::GetWord(const unsigned char *at,
+				       unsigned bytes) {
+  unsigned long word = 0;
+
+  for (unsigned i = 0; i < bytes; i++)
+    word |= (unsigned long) at[bigendian ? bytes - 1 - i : i] << (8 * i);
+  return word;
+}
+
+/* :: BigEndianWorkspace Functions :: */
+
+BigEndianWorkspace::BigEndianWorkspace(const char *file, CNIndex maxid,
+				       Workspace *higher, Workspace *lower,
+				       unsigned prity, unsigned maxsz) :
+  ImageWorkspace(file, TRUE, maxid, higher, lower, prity, maxsz) {
+  type = CBigEndianWorkspace;
+}
+
+BigEndianWorkspace::BigEndianWorkspace(FILE *fp) :
+  ImageWorkspace(fp, TRUE) {
+  verbize(-4, "debug", "Creating BigEndianWorkspace from file\n");
+}
+
+/* :: LittleEndianWorkspace Functions :: */
+
+LittleEndianWorkspace::LittleEndianWorkspace(const char *file, CNIndex maxid,
+					     Workspace *higher,
+					     Workspace *lower, unsigned prity,
+					     unsigned maxsz) :
+  ImageWorkspace(file, FALSE, maxid, higher, lower, prity, maxsz) {
+  type = CLittleEndianWorkspace;
+}
+
+LittleEndianWorkspace::LittleEndianWorkspace(FILE *fp) :
+  ImageWorkspace(fp, FALSE) {
+  verbize(-4, "debug", "Creating LittleEndianWorkspace from file\n");
+}
+
 /* :: WorkspaceElt Functions :: */
 
+unsigned long WorkspaceElt::copiedbytes = 0;
+unsigned long WorkspaceElt::touches = 0;
+
 WorkspaceElt::WorkspaceElt(WorkspaceRef &ref) :
   AIObject(CWorkspaceElt),
   reference(ref.BorrowElement().reference),
@@ -312,12 +1223,9 @@ WorkspaceElt::WorkspaceElt(WorkspaceRef &ref) :
   verbize(-5, "debug", "Creating WorkspaceElt [%ld] (R%ld)...\n", this, &ref);
   const WorkspaceElt &elt(ref.BorrowElement());
   value = elt.value;
+  heat = elt.heat;
   totalstr = elt.totalstr;
-  bondcount = elt.bondcount;
-  if (elt.root)
-    root = new WorkspaceBond(*elt.root);
-  else
-    root = NULL;
+  CopyBonds(elt);
 
   if (elt.squeue.GetSystem())
     squeue = elt.squeue;
@@ -334,7 +1242,8 @@ WorkspaceElt::WorkspaceElt(WorkspaceRef &ref) :
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
@@ -344,12 +1253,9 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy) :
   salientloc(copy.salientloc) {
   verbize(-5, "debug", "Creating WorkspaceElt [%ld] (E%ld)...\n", this, &copy);
   value = copy.value;
+  heat = copy.heat;
   totalstr = copy.totalstr;
-  bondcount = copy.bondcount;
-  if (copy.root)
-    root = new WorkspaceBond(*copy.root);
-  else
-    root = NULL;
+  CopyBonds(copy);
 
   if (copy.squeue.GetSystem())
     squeue = copy.squeue;
@@ -366,7 +1272,8 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy) :
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
@@ -375,12 +1282,9 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy, WorkspaceRef &ref) :
   AIObject(CWorkspaceElt), reference(ref), salientloc(copy.salientloc) {
   verbize(-5, "debug", "Creating WorkspaceElt [%ld] (K%ld)...\n", this, &copy);
   value = copy.value;
+  heat = copy.heat;
   totalstr = copy.totalstr;
-  bondcount = copy.bondcount;
-  if (copy.root)
-    root = new WorkspaceBond(*copy.root);
-  else
-    root = NULL;
+  CopyBonds(copy);
 
   if (copy.squeue.GetSystem())
     squeue = copy.squeue;
@@ -397,7 +1301,8 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy, WorkspaceRef &ref) :
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
@@ -407,12 +1312,9 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy, WorkspaceRef &ref,
   AIObject(CWorkspaceElt), reference(ref), salientloc(loc) {
   verbize(-5, "debug", "Creating WorkspaceElt [%ld] (K%ld)...\n", this, &copy);
   value = copy.value;
+  heat = copy.heat;
   totalstr = copy.totalstr;
-  bondcount = copy.bondcount;
-  if (copy.root)
-    root = new WorkspaceBond(*copy.root);
-  else
-    root = NULL;
+  CopyBonds(copy);
 
   if (copy.squeue.GetSystem())
     squeue = copy.squeue;
@@ -429,7 +1331,8 @@ WorkspaceElt::WorkspaceElt(const WorkspaceElt &copy, WorkspaceRef &ref,
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
@@ -440,9 +1343,9 @@ WorkspaceElt::WorkspaceElt(Value val) :
   salientloc(*(new WorkspaceRef(NULL, 0))) {
   verbize(-5, "debug", "Creating WorkspaceElt [%ld] (V%d)...\n", this, val);
   value = val;
-  root = NULL;
+  heat = HeatClock();  /* as if touched once, just now */
+  InitBonds();
   totalstr = 0;
-  bondcount = 0;
   squeue = NULL;
 
   allocated = 1;
@@ -455,7 +1358,8 @@ WorkspaceElt::WorkspaceElt(Value val) :
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
@@ -463,12 +1367,23 @@ WorkspaceElt::WorkspaceElt(Value val) :
 WorkspaceElt::WorkspaceElt(FILE *fp, WorkspaceRef &refloc,
 			   WorkspaceRef &salloc) :
   AIObject(fp), reference(refloc), salientloc(salloc) {
+  unsigned count;
+
   fread(&allocated, sizeof(int), 1, fp);
   fread(&value, sizeof(Value), 1, fp);
+  fread(&heat, sizeof(double), 1, fp);
   fread(squeue.GetSystemPP(), sizeof(EvolSystem *), 1, fp);
-  fread(&root, sizeof(WorkspaceBond *), 1, fp);
   fread(&totalstr, sizeof(BondStrength), 1, fp);
-  fread(&bondcount, sizeof(unsigned), 1, fp);
+  fread(&count, sizeof(unsigned), 1, fp);
+  InitBonds();
+  if (count) {
+    while (bondroom < count)
+      GrowBonds();
+    fread(bonds, sizeof(WorkspaceBond), count, fp);
+    for (bondcount = 0; bondcount < count; bondcount++)
+      TrackLink::MemStore(trackid, &bonds[bondcount].toelement, FALSE);
+    cumstale = TRUE;
+  }
   fread(&uppref, sizeof(Workspace *), 1, fp);
   fread(&dnpref, sizeof(Workspace *), 1, fp);
   fread(&uppull, sizeof(unsigned char), 1, fp);
@@ -477,17 +1392,20 @@ WorkspaceElt::WorkspaceElt(FILE *fp, WorkspaceRef &refloc,
   TrackLink::MemStore(trackid, &reference, CONST_FLAG);
   TrackLink::MemStore(trackid, &salientloc, CONST_FLAG);
   TrackLink::MemStore(trackid, squeue.GetSystemPP(), FALSE);
-  TrackLink::MemStore(trackid, &root, FALSE);
+  TrackLink::MemStore(trackid, &bonds, FALSE);
+  TrackLink::MemStore(trackid, &cumstr, FALSE);
   TrackLink::MemStore(trackid, &uppref, FALSE);
   TrackLink::MemStore(trackid, &dnpref, FALSE);
 }
 
 WorkspaceElt::~WorkspaceElt() {
-  verbize(-6, "debug", "Deleting WorkspaceElt %ld (%ld, %d)...\n",
-	  this, root, allocated);
+  verbize(-6, "debug", "Deleting WorkspaceElt %ld (%d, %d)...\n",
+	  this, bondcount, allocated);
 
-  if (root)
-    delete root;
+  if (bonds) {
+    aifree(bonds);
+    aifree(cumstr);
+  }
 
   if (allocated) {
     delete &reference;
@@ -499,54 +1417,126 @@ Value WorkspaceElt::GetValue() const {
   return value;
 }
 
+WorkspaceRef &WorkspaceElt::GetReference() const {
+  return reference;
+}
+
 WorkspaceRef &WorkspaceElt::GetSalientLoc() const {
   return salientloc;
 }
 
 void WorkspaceElt::AddBond(WorkspaceRef &toelt, BondStrength str,
 			   BondType type) {
-  if (str > 0.) {
-    WorkspaceBond *bond = new WorkspaceBond(reference, toelt, str, type);
-    AddBond(bond);
+  if (str <= 0.)
+    return;
+  if (str > 1.)
+    str = 1.;
+
+  verbize(-5, "debug", "Adding new bond: %ld {%f}\n", &toelt, str);
+  pthread_mutex_t *lock = Lock();
+  if (bondcount == bondroom)
+    GrowBonds();
+  WorkspaceBond &bond = bonds[bondcount];
+  bond.toelement = &toelt;
+  bond.strength = str;
+  bond.type = type;
+  TrackLink::MemStore(trackid, &bond.toelement, FALSE);
+  bondcount++;
+  totalstr += str;
+
+  /* its Fenwick node sums the subtrees to its left */
+  if (!cumstale) {
+    unsigned node = bondcount;
+    BondStrength sum = str;
+    for (unsigned child = node - 1; child > node - (node & -node);
+	 child -= child & -child)
+      sum += cumstr[child - 1];
+    cumstr[node - 1] = sum;
   }
+  Unlock(lock);
+  Touch();
 }
 
-void WorkspaceElt::AddBond(WorkspaceBond *bond) {
-  if (bond->GetStrength() > 0.) {
-    verbize(-5, "debug", "Adding new bond: %ld\n", bond);
-    bond->SetNextBond(root);
-    root = bond;
-    bondcount++;
-  } else
-    delete bond;
+int WorkspaceElt::SelectRandomBond() const {
+  if (!bondcount)
+    return NO_BOND;
+  return irand(bondcount);
 }
 
-WorkspaceBond *WorkspaceElt::SelectRandomBond() const {
-  unsigned choice = irand(bondcount);
-  WorkspaceBond *curr = root;
+/* Descend the Fenwick tree: O(log bondcount) */
+int WorkspaceElt::SelectWeightBond() const {
+  BondStrength total = 0.;
+  unsigned node, step, pos = 0;
 
-  while (choice && curr)
-    curr = curr->GetNextBond();
+  if (!bondcount)
+    return NO_BOND;
 
-  return curr;
+  pthread_mutex_t *lock = Lock();
+  if (cumstale)
+    RebuildCumulative();
+
+  for (node = bondcount; node; node -= node & -node)
+    total += cumstr[node - 1];
+  double choice = frand() * total;
+
+  verbize(-6, "debug", "Finding a bond of %d: %f\n", bondcount, choice);
+
+  for (step = 1; step * 2 <= bondcount; step *= 2);
+  for (; step; step /= 2)
+    if (pos + step <= bondcount && cumstr[pos + step - 1] <= choice) {
+      pos += step;
+      choice -= cumstr[pos - 1];
+    }
+  if (pos >= bondcount)
+    pos = bondcount - 1;  /* only by rounding */
+  Unlock(lock);
+
+  return pos;
 }
 
-WorkspaceBond *WorkspaceElt::SelectWeightBond() const {
-  double choice = frand() * totalstr;
-  WorkspaceBond *curr = root;
+/* A copy, since the array may move when another bond is added */
+WorkspaceBond WorkspaceElt::GetBond(unsigned slot) const {
+  WorkspaceBond bond;
 
-  verbize(-6, "debug", "Finding a bond %ld: %f\n", curr, choice);
+  pthread_mutex_t *lock = Lock();
+  aiassert(slot < bondcount, "bond slot in range");
+  bond = bonds[slot];
+  Unlock(lock);
 
-  if (!curr)
-    return NULL;
+  return bond;
+}
 
-  while (choice > curr->GetStrength()) {
-    verbize(-7, "debug", "Bond check %ld => %f\n", curr, curr->GetStrength());
-    choice -= curr->GetStrength();
-    curr = curr->GetNextBond();
-  }
+void WorkspaceElt::SetBondStrength(unsigned slot, BondStrength str) {
+  if (str > 1.)
+    str = 1.;
+
+  pthread_mutex_t *lock = Lock();
+  aiassert(slot < bondcount, "bond slot in range");
+  totalstr += str - bonds[slot].strength;
+  AdjustCumulative(slot, str - bonds[slot].strength);
+  bonds[slot].strength = str;
+  Unlock(lock);
+}
+
+void WorkspaceElt::StrengthenBond(unsigned slot, Confidence cred) {
+  pthread_mutex_t *lock = Lock();
+  SetBondStrength(slot, GetBond(slot).GetStrength() *
+		  (1.0 + STRMOD_FACTOR * cred));
+  Unlock(lock);
+}
+
+void WorkspaceElt::WeakenBond(unsigned slot, Confidence cred) {
+  pthread_mutex_t *lock = Lock();
+  SetBondStrength(slot, GetBond(slot).GetStrength() *
+		  (1.0 - STRMOD_FACTOR * cred));
+  Unlock(lock);
+}
 
-  return curr;
+void WorkspaceElt::SetBondType(unsigned slot, BondType type) {
+  pthread_mutex_t *lock = Lock();
+  aiassert(slot < bondcount, "bond slot in range");
+  bonds[slot].type = type;
+  Unlock(lock);
 }
 
 BondStrength WorkspaceElt::GetTotalStr() const {
@@ -557,6 +1547,71 @@ unsigned WorkspaceElt::GetBondCount() const {
   return bondcount;
 }
 
+void WorkspaceElt::InitBonds() {
+  bonds = NULL;
+  cumstr = NULL;
+  cumstale = FALSE;
+  bondcount = 0;
+  bondroom = 0;
+}
+
+/* One block copy of the bonds and their sums; every element copy
+   passes through here, so it is counted here too */
+void WorkspaceElt::CopyBonds(const WorkspaceElt &copy) {
+  __sync_fetch_and_add(&copiedbytes, sizeof(WorkspaceElt) + copy.bondcount *
+		       (sizeof(WorkspaceBond) + sizeof(BondStrength)));
+
+  InitBonds();
+  if (!copy.bondcount)
+    return;
+
+  pthread_mutex_t *lock = copy.Lock();
+  while (bondroom < copy.bondcount)
+    GrowBonds();
+  memcpy(bonds, copy.bonds, sizeof(WorkspaceBond) * copy.bondcount);
+  memcpy(cumstr, copy.cumstr, sizeof(BondStrength) * copy.bondcount);
+  cumstale = copy.cumstale;
+  for (; bondcount < copy.bondcount; bondcount++)
+    TrackLink::MemStore(trackid, &bonds[bondcount].toelement, FALSE);
+  copy.Unlock(lock);
+}
+
+/* Doubles the room; the stored slot pointers move with the array */
+void WorkspaceElt::GrowBonds() {
+  unsigned room = bondroom ? 2 * bondroom : BOND_ROOM;
+
+  if (bonds)
+    TrackLink::MemRemoveRange(trackid, bonds, sizeof(WorkspaceBond) * bondroom);
+  bonds = (WorkspaceBond *) airealloc(bonds, sizeof(WorkspaceBond) * room,
+				      "element bonds", 1, -2);
+  cumstr = (BondStrength *) airealloc(cumstr, sizeof(BondStrength) * room,
+				      "element bond sums", 1, -2);
+  for (unsigned i = 0; i < bondcount; i++)
+    TrackLink::MemStore(trackid, &bonds[i].toelement, FALSE);
+  bondroom = room;
+}
+
+void WorkspaceElt::AdjustCumulative(unsigned slot, BondStrength diff) {
+  if (cumstale)
+    return;
+  for (unsigned node = slot + 1; node <= bondcount; node += node & -node)
+    cumstr[node - 1] += diff;
+}
+
+/* O(bondcount): each node passes its sum up to its parent */
+void WorkspaceElt::RebuildCumulative() const {
+  unsigned node, parent;
+
+  for (node = 1; node <= bondcount; node++)
+    cumstr[node - 1] = bonds[node - 1].strength;
+  for (node = 1; node <= bondcount; node++) {
+    parent = node + (node & -node);
+    if (parent <= bondcount)
+      cumstr[parent - 1] += cumstr[node - 1];
+  }
+  cumstale = FALSE;
+}
+
 void WorkspaceElt::Pull(Workspace *puller) {
   Workspace *currws = reference.GetWorkspace();
   unsigned currpy = currws->GetPriority();
@@ -580,9 +1635,10 @@ void WorkspaceElt::Pull(Workspace *puller) {
       dnpull--;
 
     /* if sufficient pull, move! */
-    if (uppull >= SUFF_PULL)
-      uppref->DataSwitch(uppref->SalientElement(irand(uppref->GetMaxIndex())),
-			 reference);
+    if (uppull >= SUFF_PULL) {
+      uppull = 0;
+      uppref->Admit(reference);
+    }
   } else { /* encourage downward movement */
     if (!dnpull) {
       dnpref = puller;
@@ -596,33 +1652,63 @@ void WorkspaceElt::Pull(Workspace *puller) {
       uppull--;
 
     /* if sufficient pull, move! */
-    if (dnpull >= SUFF_PULL)
-      dnpref->DataSwitch(dnpref->SalientElement(irand(dnpref->GetMaxIndex())),
-			 reference);
+    if (dnpull >= SUFF_PULL) {
+      dnpull = 0;
+      dnpref->Admit(reference);
+    }
   }
 }
 
+double WorkspaceElt::GetHeat() const {
+  return heat;
+}
+
+/* heat = log(e^heat + e^now): one more touch, on the clock's scale.
+   Swapped in whole, so concurrent touches of an element all count. */
+void WorkspaceElt::Touch() {
+  double now = __sync_add_and_fetch(&touches, 1) * (M_LN2 / HEAT_HALFLIFE);
+  union {double heat; unsigned long bits;} was, next;
+
+  do {
+    was.heat = heat;
+    next.heat = now + log1p(exp(was.heat - now));
+  } while (!__sync_bool_compare_and_swap((unsigned long *) &heat, was.bits,
+					 next.bits));
+  if (reference.GetWorkspace())
+    reference.GetWorkspace()->LogTouch(reference.GetLocation());
+}
+
+double WorkspaceElt::HeatClock() {
+  return touches * (M_LN2 / HEAT_HALFLIFE);
+}
+
 int WorkspaceElt::AddQueue(EvolSystemPtr newsys) {
-  if (squeue.GetSystem()) {
-    EvolSystemPtr saved = squeue;
+  int first;
 
+  pthread_mutex_t *lock = Lock();
+  if (squeue.GetSystem()) {
     squeue = new EvolSystemCombo(squeue, newsys);
     verbize(-6, "debug", "Creating for queue on %ld new combo %ld\n", this,
 	    squeue.GetSystem());
-    return 0;
+    first = 0;
   } else {
-    squeue = newsys;
+    squeue.Swap(newsys);
     verbize(-6, "debug", "Creating queue initially on %ld with %ld\n", this,
 	    squeue.GetSystem());
-    return 1;
+    first = 1;
   }
+  Unlock(lock);
+  Touch();
+  return first;
 }
 
 EvolSystemPtr WorkspaceElt::RemoveQueue() {
+  pthread_mutex_t *lock = Lock();
   verbize(-7, "debug", "Removing Queue on %ld to produce sys %ld\n", this,
 	  squeue.GetSystem());
-  EvolSystemPtr saved = squeue;
-  squeue = NULL;
+  EvolSystemPtr saved;
+  saved.Swap(squeue);
+  Unlock(lock);
   return saved;
 }
 
@@ -641,17 +1727,58 @@ urgetype WorkspaceElt::QueueUrgency() const {
 	   (float) salientloc.GetWorkspace()->GetMaxIndex()));
 }
 
+/* An element edited in place is already there.  One that isn't may be
+   on the stack or already retired by another commit, so it is copied */
 void WorkspaceElt::Commit() const {
   verbize(-5, "debug", "Commiting element %ld to workspace %ld\n",
 	  &reference, reference.GetWorkspace());
+  pthread_mutex_t *lock = Lock();
   if (this == reference.GetWorkspace()->GetElement(reference.GetLocation())) {
+    Unlock(lock);
     verbize(-7, "debug", "Trivial Commit\n");
     return; // Nothing to do
   }
   reference.GetWorkspace()->SetElement(reference.GetLocation(), *this);
+  Unlock(lock);
   verbize(-7, "debug", "Successful commit\n");
 }
 
+/* O(1) whatever the bond count: the workspace keeps this very element */
+void WorkspaceElt::CommitStolen() {
+  verbize(-5, "debug", "Commiting stolen element %ld to workspace %ld\n",
+	  &reference, reference.GetWorkspace());
+  pthread_mutex_t *lock = Lock();
+  reference.GetWorkspace()->SetElement(reference.GetLocation(), this);
+  Unlock(lock);
+}
+
+/* Retried if the reference moved while it waited, so the stripe held
+   is the one its slot has now */
+pthread_mutex_t *WorkspaceElt::Lock() const {
+  Workspace *ws;
+  CNIndex loc;
+  pthread_mutex_t *lock;
+
+  if (!aithreaded)
+    return NULL;
+  for (;;) {
+    ws = reference.GetWorkspace();
+    loc = reference.GetLocation();
+    if (!ws)
+      return NULL;
+    lock = ws->ElementLock(loc);
+    pthread_mutex_lock(lock);
+    if (ws == reference.GetWorkspace() && loc == reference.GetLocation())
+      return lock;
+    pthread_mutex_unlock(lock);
+  }
+}
+
+void WorkspaceElt::Unlock(pthread_mutex_t *lock) const {
+  if (lock)
+    pthread_mutex_unlock(lock);
+}
+
 int WorkspaceElt::WriteObject(FILE *fp) {
   WorkspaceRef *wr1 = &reference;
   WorkspaceRef *wr2 = &salientloc;
@@ -661,10 +1788,11 @@ int WorkspaceElt::WriteObject(FILE *fp) {
   result = AIObject::WriteObject(fp) + result;
   result = fwrite(&allocated, sizeof(int), 1, fp) + result;
   result = fwrite(&value, sizeof(Value), 1, fp) + result;
+  result = fwrite(&heat, sizeof(double), 1, fp) + result;
   result = fwrite(squeue.GetSystemPP(), sizeof(EvolSystem *), 1, fp) + result;
-  result = fwrite(&root, sizeof(WorkspaceBond *), 1, fp) + result;
   result = fwrite(&totalstr, sizeof(BondStrength), 1, fp) + result;
   result = fwrite(&bondcount, sizeof(unsigned), 1, fp) + result;
+  result = fwrite(bonds, sizeof(WorkspaceBond), bondcount, fp) + result;
   result = fwrite(&uppref, sizeof(Workspace *), 1, fp) + result;
   result = fwrite(&dnpref, sizeof(Workspace *), 1, fp) + result;
   result = fwrite(&uppull, sizeof(unsigned char), 1, fp) + result;
@@ -682,13 +1810,14 @@ static bool_t WorkspaceElt::xdr_proc(XDR *xdrs, WorkspaceElt *elt) {
     return FALSE;
   if (!xdr_value(xdrs, &elt->value))
     return FALSE;
-  if (!EvolSystemPtr::xdr_proc(xdrs, &elt->squeue))
+  if (!xdr_double(xdrs, &elt->heat))
     return FALSE;
-  if (!WorkspaceBond::xdr_proc(xdrs, &elt->root))
+  if (!EvolSystemPtr::xdr_proc(xdrs, &elt->squeue))
     return FALSE;
   if (!xdr_bondstrength(xdrs, &elt->totalstr))
     return FALSE;
-  if (!xdr_u_int(xdrs, &elt->bondcount))
+  if (!xdr_array(xdrs, &elt->bonds, &elt->bondcount, ~0,
+		 sizeof(WorkspaceBond), WorkspaceBond::xdr_proc))
     return FALSE;
   if (!Workspace::xdr_ptr(xdrs, &elt->uppref))
     return FALSE;
@@ -731,6 +1860,18 @@ WorkspaceElt &WorkspaceRef::GetElement() {
 
 WorkspaceElt &WorkspaceRef::GetElement(Workspace *puller) {
   GetWorkspace()->GetElement(GetLocation())->Pull(puller); /* pull toward that workspace */
+  GetWorkspace()->GetElement(GetLocation())->Touch();
+  return *GetWorkspace()->GetElement(GetLocation());
+}
+
+/* A use on the top level only lets its pulls fade */
+WorkspaceElt &WorkspaceRef::UseElement() {
+  Workspace *higher = GetWorkspace()->GetHigherWorkspace();
+
+  GetWorkspace()->CountAccess();
+  GetWorkspace()->GetElement(GetLocation())->
+    Pull(higher ? higher : GetWorkspace());
+  GetWorkspace()->GetElement(GetLocation())->Touch();
   return *GetWorkspace()->GetElement(GetLocation());
 }
 
@@ -741,6 +1882,7 @@ WorkspaceElt *WorkspaceRef::StealElement() {
 
 WorkspaceElt *WorkspaceRef::StealElement(Workspace *puller) {
   GetWorkspace()->GetElement(GetLocation())->Pull(puller); /* pull toward that workspace */
+  GetWorkspace()->GetElement(GetLocation())->Touch();
   return new WorkspaceElt(*(GetWorkspace()->GetElement(GetLocation()))); // give copy
 }
 
@@ -780,70 +1922,11 @@ static bool_t WorkspaceRef::xdr_proc(XDR *xdrs, WorkspaceRef *ref) {
 
 /* :: WorkspaceBond Functions :: */
 
-WorkspaceBond::WorkspaceBond(WorkspaceRef &fromelt, WorkspaceRef &toelt, 
-			     BondStrength str, BondType ntype) :
-  AIObject(CWorkspaceBond), fromelement(fromelt), toelement(toelt) {
-  verbize(-5, "debug", "Creating WorkspaceBond [%ld] (XXXX) {%f}...\n", this,
-	  str);
-  if (str > 1.)
-    strength = 1.;
-  else
-    strength = str;
-  type = ntype;
-  next = NULL;
-  UpdateTotalStr(strength);
-
-  TrackLink::MemStore(trackid, &fromelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &toelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &next, FALSE);
-}
-
-WorkspaceBond::WorkspaceBond(WorkspaceBond &copy) :
-  AIObject(CWorkspaceBond), fromelement(copy.fromelement),
-  toelement(copy.toelement) {
-  verbize(-5, "debug", "Creating WorkspaceBond [%ld] (%ld) {%f}...\n", this,
-	  copy.next, copy.strength);
-  strength = copy.strength;
-  if (copy.next)
-    next = new WorkspaceBond(*copy.next);
-  else
-    next = NULL;
-
-  TrackLink::MemStore(trackid, &fromelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &toelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &next, FALSE);
-}
-
-WorkspaceBond::WorkspaceBond(FILE *fp, WorkspaceRef &from, WorkspaceRef &to) :
-  AIObject(fp), fromelement(from), toelement(to) {
-  fread(&strength, sizeof(BondStrength), 1, fp);
-  fread(&type, sizeof(BondType), 1, fp);
-  fread(&next, sizeof(WorkspaceBond *), 1, fp);
-
-  TrackLink::MemStore(trackid, &fromelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &toelement, CONST_FLAG);
-  TrackLink::MemStore(trackid, &next, FALSE);
-}  
-
-WorkspaceBond::~WorkspaceBond() {
-  verbize(-5, "debug", "Deleting WorkspaceBond [%ld] (%ld)...\n", this, next);
-  if (next)
-    delete next;
-}
-
-WorkspaceRef &WorkspaceBond::To() {
-  return toelement;
-}
-
-void WorkspaceBond::SetNextBond(WorkspaceBond *bond) {
-  next = bond;
-}
-
-WorkspaceBond *WorkspaceBond::GetNextBond() {
-  return next;
+WorkspaceRef &WorkspaceBond::To() const {
+  return *toelement;
 }
 
-BondStrength WorkspaceBond::GetStrength() {
+BondStrength WorkspaceBond::GetStrength() const {
   if (strength > 1.) {
     printf("Ahh!!!, str = %f\n", strength);
     exit(-2);
@@ -851,59 +1934,16 @@ BondStrength WorkspaceBond::GetStrength() {
   return strength;
 }
 
-void WorkspaceBond::SetStrength(BondStrength str) {
-  if (str > 1.)
-    str = 1.;
-  UpdateTotalStr(str - strength);
-  strength = str;
-}
-
-void WorkspaceBond::Strengthen(Confidence cred) {
-  SetStrength(GetStrength() * (1.0 + STRMOD_FACTOR * cred));
-}
-
-void WorkspaceBond::Weaken(Confidence cred) {
-  SetStrength(GetStrength() * (1.0 - STRMOD_FACTOR * cred));
-}
-
-void WorkspaceBond::UpdateTotalStr(BondStrength diff) {
-  WorkspaceElt &elt(fromelement.GetElement());
-  elt.totalstr += diff;
-}
-
-BondType WorkspaceBond::GetType() {
+BondType WorkspaceBond::GetType() const {
   return type;
 }
 
-void WorkspaceBond::SetType(BondType newtype) {
-  type = newtype;
-}
-
-int WorkspaceBond::WriteObject(FILE *fp) {
-  WorkspaceRef *wr1 = &fromelement;
-  WorkspaceRef *wr2 = &toelement;
-
-  size_t result = fwrite(&wr1, sizeof(WorkspaceRef *), 1, fp);
-  result = fwrite(&wr1, sizeof(WorkspaceRef *), 1, fp) + result;
-  result = AIObject::WriteObject(fp) + result;
-  result = fwrite(&strength, sizeof(BondStrength), 1, fp) + result;
-  result = fwrite(&type, sizeof(BondType), 1, fp) + result;
-  return fwrite(&next, sizeof(WorkspaceBond *), 1, fp) + result;
-}
-
 static bool_t WorkspaceBond::xdr_proc(XDR *xdrs, WorkspaceBond *bond) {
-  if (!xdr_reference(xdrs, &bond->fromelement, sizeof(WorkspaceRef),
-		     WorkspaceRef::xdr_proc))
-    return FALSE;
-  if (!xdr_reference(xdrs, &bond->toelement, sizeof(WorkspaceRef),
-		     WorkspaceRef::xdr_proc))
+  if (!WorkspaceRef::xdr_ptr(xdrs, &bond->toelement))
     return FALSE;
   if (!xdr_bondstrength(xdrs, &bond->strength))
     return FALSE;
   if (!xdr_enum(xdrs, (enum_t *) &bond->type))
     return FALSE;
-  if (!xdr_pointer(xdrs, &bond->next, sizeof(WorkspaceBond),
-		   WorkspaceBond::xdr_proc);
-    return FALSE;
   return TRUE;
 }
@@ -13,8 +13,10 @@ bool_t xdr_bondstrength(XDR *xdrs, BondStrength *id);
 
 typedef unsigned char Value;
 bool_t xdr_value(XDR *xdrs, Value *val);
+#define VALUE_BUCKETS 256  /* one per Value */
+#define VALUE_ROOM 16  /* positions a value bucket first makes room for */
 
-#define SUFF_PULL 256
+#define SUFF_PULL 32  /* net pulls before an element changes level */
 
 class Workspace;
 class MemoryWorkspace;
@@ -30,6 +32,30 @@ class WorkspaceRef;
 #define nullwsref (Workspace *) NULL
 #define STRMOD_FACTOR .1
 #define MAX_MEMWSSIZE 65536
+#define WS_CHUNK_BITS 12  /* MemoryWorkspaces grow 4096 elements at a time */
+#define WS_CHUNK (1UL << WS_CHUNK_BITS)
+#define WS_CHUNK_ROOM 16  /* chunk table entries first made room for */
+#define WS_MEMORY_CEILING 256  /* default megabytes for the base workspace */
+#define EVICT_SAMPLES 4  /* positions looked at to pick an eviction */
+#define TOWER_MAX 8  /* most levels in a workspace tower */
+#define TOWER_TOP_BYTES (1UL << 20)  /* the top level, to stay in L2 */
+#define TOWER_SHARE 4  /* codelet budget of a level over the one below */
+#define HEAT_HALFLIFE 65536.  /* touches, in all workspaces, to halve a heat */
+#define HEAT_LOG 256  /* touched locations held for the next heat lookup */
+#define WS_LOCK_STRIPES 64  /* element locks per workspace, by index */
+#define BOND_ROOM 4  /* bonds an element first makes room for */
+#define NO_BOND -1  /* bond slot when an element has none */
+#define UNINDEXED ((CNIndex) -1)  /* salient position in no value bucket */
+
+/* Workspace image files: a header, then a record per element, then the
+   element location at each salient position, every field an unsigned
+   integer in the image's byte order */
+#define WSIMG_VERSION 1
+#define WSIMG_HEADER 24  /* "CNWS", version: 2, order, pad, count: 8, max: 8 */
+#define WSIMG_BONDS 8    /* strongest bonds an element keeps in an image */
+#define WSIMG_BOND 13    /* to: 8, strength bits: 4, type: 1 */
+#define WSIMG_RECORD (2 + WSIMG_BONDS * WSIMG_BOND)  /* value, bonds kept */
+#define WSIMG_SALIENT 8  /* location at a salient position */
 
 typedef enum {
   UndefBond, DataBond, EvolaiBond
@@ -45,6 +71,8 @@ public:
 
   WorkspaceRef &AddElement(WorkspaceElt &elt);
   WorkspaceRef &AddElement(WorkspaceRef &ref); /* doesn't create new reference */
+  /* Swaps ref's element, on another level, for a cold one of this one */
+  WorkspaceRef &Admit(WorkspaceRef &ref);
 
   /* serious move must change all references */
   virtual WorkspaceRef &DataShift(CNIndex id, Workspace *newws,
@@ -56,6 +84,10 @@ public:
 
   virtual WorkspaceElt *GetElement(CNIndex id) = NULL;
   virtual void SetElement(CNIndex id, const WorkspaceElt &elt) = NULL;
+  virtual void SetElement(CNIndex id, WorkspaceElt *elt) = NULL;  // -elt
+  /* Installs elt without copying it */
+  virtual WorkspaceElt *SwapElement(CNIndex id, WorkspaceElt *elt)
+    = NULL;  // -elt, + the element it replaces
 
   virtual WorkspaceRef &SalientElement(CNIndex i) = NULL;
   void SalientSwitch(CNIndex id, WorkspaceRef &ref, CNIndex oldid,
@@ -63,38 +95,104 @@ public:
   /* Move salient item from to my index id (and
      move my item to where it is) */
 
+  /* Salient positions by value: O(1) per update and per lookup */
+  int SalientWithValue(Value val, CNIndex exclude, CNIndex *found);
+  void IndexSalient(CNIndex i);  // after salient position i changes
+
+  /* Locations by element heat, in an indexed max-heap: O(log n) to
+     rerank one, O(k log k) for the k hottest.  Touches are only logged,
+     without a lock, and reranked by the next lookup. */
+  void RankElement(CNIndex id);  // after its element or that's heat changes
+  void LogTouch(CNIndex id);
+  CNIndex HottestElements(CNIndex *found, CNIndex k);  // hottest first
+  CNIndex HotElement();  // drawn toward the hottest; needs an element
+
   Workspace *GetHigherWorkspace();
   Workspace *GetLowerWorkspace();
   void SetHigherWorkspace(Workspace *higher);
   void SetLowerWorkspace(Workspace *lower);
 
   CNIndex GetCurrentIndex();
-  CNIndex GetMaxIndex();
+  CNIndex GetMaxIndex();  // the ceiling; only GetCurrentIndex are in use
+  unsigned long GetEvictions();
+  unsigned long GetPromotions();  // elements sent up from this level
+  unsigned long GetDemotions();   // elements sent down from this level
+  unsigned long GetAccesses();    // elements used while on this level
+  void CountAccess();
   unsigned GetPriority();
 
+  unsigned GetBudget();  // codelets run per pass of the main loop
+  void SetBudget(unsigned codelets);
+
   Coderack &GetCoderack();
 
+  /* Element locks for parallel coderacks; no-ops until threaded */
+  void LockElement(CNIndex id);
+  void UnlockElement(CNIndex id);
+  pthread_mutex_t *ElementLock(CNIndex id);
+  static void LockPair(pthread_mutex_t *one, pthread_mutex_t *two);
+  static void UnlockPair(pthread_mutex_t *one, pthread_mutex_t *two);
+
   virtual int WriteObject(FILE *fp);
 
   static bool_t xdr_proc(XDR *xdrs, Workspace *ws);
 
 protected:
   CNIndex currindex;
+  unsigned long evictions;  /* elements forgotten at the ceiling */
+  unsigned long promotions, demotions, accesses;
 
 private:
+  void InitStripes();
+  CNIndex EvictionVictim();
+  CNIndex ColdElement();
+  void InitValueIndex();
+  void UnindexSalient(CNIndex i);
+  void RebuildValueIndex();
+  void InitHeatRank();
+  void SiftHot(CNIndex h);
+  void RebuildHeatRank();
+  void RankTouched();
+
   virtual WorkspaceRef &RoomAddElement(WorkspaceElt &elt) = NULL;
   virtual WorkspaceRef &RoomAddElement(WorkspaceRef &ref) = NULL;
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceElt &elt) = NULL;
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceRef &ref) = NULL;
   virtual void SetSalient(CNIndex i, WorkspaceRef &ref) = NULL;
 
   Workspace *higherws;
   Workspace *lowerws;
   CNIndex maxindex;
   unsigned priority;
+  unsigned budget;
 
   Coderack *theCoderack;
+
+  pthread_mutex_t stripes[WS_LOCK_STRIPES];
+
+  CNIndex *valpos[VALUE_BUCKETS];  /* salient positions holding each value */
+  CNIndex valcount[VALUE_BUCKETS];
+  CNIndex valroom[VALUE_BUCKETS];
+  CNIndex *valslot;  /* each position's place in its bucket, or UNINDEXED */
+  Value *posval;  /* and the bucket it is in */
+  CNIndex valtop;  /* positions these have room for */
+  int valstale;  /* rebuild before the next lookup */
+  pthread_mutex_t vallock;
+
+  CNIndex *hotheap;  /* locations, in heap order by heat */
+  double *hotkey;  /* the heat each was ranked with */
+  CNIndex *hotpos;  /* each location's place in hotheap, or UNINDEXED */
+  CNIndex hotcount;
+  CNIndex hottop;  /* locations these have room for */
+  int hotstale;
+  CNIndex hotlog[HEAT_LOG];  /* touched locations, by location, or UNINDEXED */
+  unsigned long hotlogged;  /* nonzero if hotlog may hold any */
+  pthread_mutex_t hotlock;
 };
 
-/* Workspace information stored in RAM */
+/* Workspace information stored in RAM, in chunks of WS_CHUNK elements
+   found through a chunk table; chunks never move once made, so neither
+   do stored element and reference pointers */
 class MemoryWorkspace : public Workspace {
 public:
   MemoryWorkspace(CNIndex maxid, Workspace *higher, Workspace *lower,
@@ -102,6 +200,8 @@ public:
   MemoryWorkspace(FILE *fp);
   ~MemoryWorkspace();
 
+  static CNIndex CeilingIndex(unsigned long bytes);  // elements that fit
+
   virtual WorkspaceRef &DataShift(CNIndex id, Workspace *newws,
 				  WorkspaceElt &repl);
   virtual WorkspaceRef &DataShift(CNIndex id, Workspace *newws,
@@ -110,6 +210,8 @@ public:
 
   virtual WorkspaceElt *GetElement(CNIndex id);
   virtual void SetElement(CNIndex id, const WorkspaceElt &elt);
+  virtual void SetElement(CNIndex id, WorkspaceElt *elt);  // -elt
+  virtual WorkspaceElt *SwapElement(CNIndex id, WorkspaceElt *elt); // -elt, +
 
   virtual WorkspaceRef &SalientElement(CNIndex i);
 
@@ -118,58 +220,90 @@ public:
 protected:
   virtual WorkspaceRef &RoomAddElement(WorkspaceElt &elt);
   virtual WorkspaceRef &RoomAddElement(WorkspaceRef &ref);
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceElt &elt);
+  virtual WorkspaceRef &ReplaceElement(CNIndex id, WorkspaceRef &ref);
   virtual void SetSalient(CNIndex i, WorkspaceRef &ref);
 
-  WorkspaceElt **data;
-  WorkspaceRef **refs;
+  void GrowChunks(CNIndex id);  // room up to element id
+  WorkspaceElt *&DataAt(CNIndex id) {
+    return data[id >> WS_CHUNK_BITS][id & (WS_CHUNK - 1)];
+  }
+  WorkspaceRef *&RefAt(CNIndex id) {
+    return refs[id >> WS_CHUNK_BITS][id & (WS_CHUNK - 1)];
+  }
+
+  WorkspaceElt ***data;  /* chunk table */
+  WorkspaceRef ***refs;
+  CNIndex chunks;
+  CNIndex chunkroom;
 };
 
-/* Workspace information stored in big endian file */
-/*class BigEndianWorkspace : public Workspace {
-  };*/
+/* A MemoryWorkspace that snapshots its values, bonds and salience order
+   to an image file, laid out as above, and starts from that image if one
+   is there.  The image is not mapped while running: Load copies it into
+   RAM, GetElement, SetElement and DataSwitch work on that copy, and Sync
+   rewrites the whole file.  It is how a warmed-up workspace passes
+   between processes and machines without ReadAllObjects.  Queued
+   systems aren't kept. */
+class ImageWorkspace : public MemoryWorkspace {
+public:
+  ~ImageWorkspace();
 
-/* Workspace information stored in little endian file */
-/*class LittleEndianWorkspace : public Workspace {
-  };*/
+  int Sync();  /* replaces the image; FALSE if it can't be written */
+  const char *GetPath();
 
-class WorkspaceBond : public AIObject {
-public:
-  WorkspaceBond(WorkspaceRef &fromelt, WorkspaceRef &toelt,
-		BondStrength str, BondType type);
-  WorkspaceBond(WorkspaceBond &copy);
-  WorkspaceBond(FILE *fp, WorkspaceRef &from, WorkspaceRef &to);
-  ~WorkspaceBond();
+  virtual int WriteObject(FILE *fp);
 
-  WorkspaceRef &To();
+protected:
+  ImageWorkspace(const char *file, int bigend, CNIndex maxid,
+		 Workspace *higher, Workspace *lower, unsigned prity,
+		 unsigned maxsz);
+  ImageWorkspace(FILE *fp, int bigend);
+
+private:
+  int Load();
+  void PutWord(unsigned char *at, unsigned long word, unsigned bytes);
+  unsigned long GetWord(const unsigned char *at, unsigned bytes);
 
-  void SetNextBond(WorkspaceBond *bond);
-  WorkspaceBond *GetNextBond();
+  char *path;
+  int bigendian;
+};
 
-  BondStrength GetStrength();
-  void SetStrength(BondStrength str);
-  void Strengthen(Confidence cred);
-  void Weaken(Confidence cred);
+/* Workspace information stored in big endian file */
+class BigEndianWorkspace : public ImageWorkspace {
+public:
+  BigEndianWorkspace(const char *file, CNIndex maxid, Workspace *higher,
+		     Workspace *lower, unsigned prity, unsigned maxsz);
+  BigEndianWorkspace(FILE *fp);
+};
 
-  BondType GetType();
-  void SetType(BondType newtype);
+/* Workspace information stored in little endian file */
+class LittleEndianWorkspace : public ImageWorkspace {
+public:
+  LittleEndianWorkspace(const char *file, CNIndex maxid, Workspace *higher,
+			Workspace *lower, unsigned prity, unsigned maxsz);
+  LittleEndianWorkspace(FILE *fp);
+};
 
-  virtual int WriteObject(FILE *fp);
+/* A bond out of an element, kept by value in that element's bond array;
+   its element is the from end, so change it through the element */
+class WorkspaceBond {
+  friend class WorkspaceElt;
+public:
+  WorkspaceRef &To() const;
+  BondStrength GetStrength() const;
+  BondType GetType() const;
 
   static bool_t xdr_proc(XDR *xdrs, WorkspaceBond *bond);
 
 private:
-  void UpdateTotalStr(BondStrength diff);
-
-  WorkspaceRef &fromelement;
-  WorkspaceRef &toelement;
+  WorkspaceRef *toelement;
   BondStrength strength;
   BondType type;
-  WorkspaceBond *next;
 };
 
 /* The data for a single element, needed for modifying the element */
 class WorkspaceElt : public AIObject {
-  friend void WorkspaceBond::UpdateTotalStr(BondStrength diff);
 public:
   WorkspaceElt(WorkspaceRef &ref);
   WorkspaceElt(const WorkspaceElt &copy);  // data
@@ -181,28 +315,56 @@ public:
   ~WorkspaceElt(); /* free bond memeory */
 
   Value GetValue() const;
+  WorkspaceRef &GetReference() const;
   WorkspaceRef &GetSalientLoc() const;
 
+  /* Bonds are never removed, so a slot stays valid for the element */
   void AddBond(WorkspaceRef &toelt, BondStrength str, BondType type);
-  void AddBond(WorkspaceBond *bond);  // -bond
-  WorkspaceBond *SelectRandomBond() const;
-  WorkspaceBond *SelectWeightBond() const;
+  int SelectRandomBond() const;  // slot or NO_BOND
+  int SelectWeightBond() const;  // slot or NO_BOND
+  WorkspaceBond GetBond(unsigned slot) const;
+  void SetBondStrength(unsigned slot, BondStrength str);
+  void StrengthenBond(unsigned slot, Confidence cred);
+  void WeakenBond(unsigned slot, Confidence cred);
+  void SetBondType(unsigned slot, BondType type);
   BondStrength GetTotalStr() const;
   unsigned GetBondCount() const;
 
   void Pull(Workspace *puller);
 
+  /* Heat is the log of a touch count that halves every HEAT_HALFLIFE
+     touches, plus the clock, so heats compare without being decayed */
+  double GetHeat() const;
+  void Touch();  // logs it for reranking in its workspace
+  static double HeatClock();
+
   int AddQueue(EvolSystemPtr newsys);
   EvolSystemPtr RemoveQueue();
   unsigned QueueSystemCount();
   urgetype QueueUrgency() const;
 
-  void Commit() const;
+  void Commit() const;  // copies it in unless it is the live element
+  void CommitStolen();  // -this: hands a StealElement copy back uncopied
+
+  /* Its slot's stripe in its workspace, which a move of the reference
+     may change: unlock the one that was taken, or NULL if none was */
+  pthread_mutex_t *Lock() const;
+  void Unlock(pthread_mutex_t *lock) const;
 
   virtual int WriteObject(FILE *fp);
 
   static bool_t xdr_proc(XDR *xdrs, WorkspaceElt *elt);
 
+  static unsigned long copiedbytes;  /* by element copies, for the status */
+  static unsigned long touches;
+
+private:
+  void InitBonds();
+  void CopyBonds(const WorkspaceElt &copy);
+  void GrowBonds();
+  void AdjustCumulative(unsigned slot, BondStrength diff);
+  void RebuildCumulative() const;
+
 protected:
   WorkspaceRef &reference;
   WorkspaceRef &salientloc;
@@ -210,12 +372,16 @@ protected:
   int allocated;
 
   Value value;
+  double heat;
 
   EvolSystemPtr squeue;
 
-  WorkspaceBond *root;
+  WorkspaceBond *bonds;  /* bondcount in use, room for bondroom */
+  BondStrength *cumstr;  /* Fenwick tree of bond strengths, for selection */
+  mutable int cumstale;  /* rebuild cumstr before using it */
   BondStrength totalstr;
   unsigned bondcount;
+  unsigned bondroom;
 
   Workspace *uppref;
   Workspace *dnpref;
@@ -232,6 +398,8 @@ class WorkspaceRef : public AIObject {
 						   WorkspaceRef &repl);
   friend WorkspaceRef &MemoryWorkspace::DataSwitch(WorkspaceRef &here,
 						   WorkspaceRef &repl);
+  friend WorkspaceRef &MemoryWorkspace::ReplaceElement(CNIndex id,
+						       WorkspaceRef &ref);
 public:
   WorkspaceRef(Workspace *lkup, CNIndex loc);
   WorkspaceRef(FILE *fp);
@@ -239,6 +407,9 @@ public:
 
   WorkspaceElt &GetElement();  
   WorkspaceElt &GetElement(Workspace *puller);
+  WorkspaceElt &UseElement();  // pulls it a level up its tower
+  /* A private copy to edit while other threads still read the slot;
+     CommitStolen then installs it without copying it again */
   WorkspaceElt *StealElement(); // +
   WorkspaceElt *StealElement(Workspace *puller); // +
   const WorkspaceElt &BorrowElement();